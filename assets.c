@@ -0,0 +1,369 @@
+#include "structure.h"
+
+/* Side of the checkerboard shown while an image is being decoded */
+#define PLACEHOLDER_SIZE 8
+
+/**
+ * struct AssetJob - One image being decoded in the background
+ * @asset: The asset waiting for it, NULL if the asset was freed first; only
+ * touched by the main thread.
+ * @path: The path of the image, owned by the job.
+ * @texels: The decoded texels.
+ * @columns: Their column-major mip chain.
+ * @failed: Whether the image could not be decoded.
+ * @next: The next job in the list the job is on.
+ */
+struct AssetJob
+{
+	Asset *asset;
+	char *path;
+	Texels texels;
+	ColumnMips columns;
+	bool failed;
+	AssetJob *next;
+};
+
+/**
+ * loader_main - Decodes queued images until the registry is destroyed.
+ * @data: The AssetRegistry the loader belongs to.
+ * Return: Always 0.
+ * Description: Decoding and building the mip chain only touch the CPU;
+ * the GPU upload is left to poll_assets() on the main thread.
+ */
+static int loader_main(void *data)
+{
+	AssetRegistry *registry = data;
+	AssetJob *job;
+
+	SDL_LockMutex(registry->lock);
+	while (true)
+	{
+		while (!registry->quit && !registry->queued)
+			SDL_CondWait(registry->wake, registry->lock);
+		if (registry->quit)
+			break;
+		job = registry->queued;
+		registry->queued = job->next;
+		SDL_UnlockMutex(registry->lock);
+
+		job->failed = !load_texels(job->path, &job->texels);
+		if (!job->failed)
+			job->columns = build_column_mips(&job->texels);
+
+		SDL_LockMutex(registry->lock);
+		job->next = registry->decoded;
+		registry->decoded = job;
+		SDL_CondSignal(registry->done);
+	}
+	SDL_UnlockMutex(registry->lock);
+	return (0);
+}
+
+/**
+ * init_asset_registry - Prepares an empty asset registry.
+ * @registry: The registry to initialize.
+ * @renderer: The renderer the GPU copies of the assets are created on.
+ * Description: Maps the texture pack if there is one, builds the
+ * placeholder and starts the loader threads; the program exits if either
+ * of the last two fails.
+ */
+void init_asset_registry(AssetRegistry *registry, SDL_Renderer *renderer)
+{
+	Texels *checker = &registry->placeholder.texels;
+
+	memset(registry, 0, sizeof(*registry));
+	registry->renderer = renderer;
+	open_texture_pack(TEXPACK_FILE, &registry->pack);
+	checker->w = PLACEHOLDER_SIZE;
+	checker->h = PLACEHOLDER_SIZE;
+	checker->pixels = malloc(sizeof(uint32_t) * PLACEHOLDER_SIZE *
+		PLACEHOLDER_SIZE);
+	ASSERT(checker->pixels, "Out of memory for the placeholder texture\n");
+	for (int i = 0; i < PLACEHOLDER_SIZE * PLACEHOLDER_SIZE; i++)
+		checker->pixels[i] = (i / PLACEHOLDER_SIZE + i) % 2 ?
+			0xFF606060 : 0xFF808080;
+	registry->placeholder.columns = build_column_mips(checker);
+	registry->placeholder.texture = upload_texels(renderer, checker);
+	registry->lock = SDL_CreateMutex();
+	registry->wake = SDL_CreateCond();
+	registry->done = SDL_CreateCond();
+	ASSERT(registry->lock && registry->wake && registry->done,
+		"Failed to create the asset loader: %s\n", SDL_GetError());
+	for (int i = 0; i < ASSET_LOADERS; i++)
+	{
+		registry->loaders[i] = SDL_CreateThread(loader_main, "asset loader",
+			registry);
+		ASSERT(registry->loaders[i], "Failed to start an asset loader: %s\n",
+			SDL_GetError());
+	}
+}
+
+/**
+ * find_asset - Looks up an already loaded asset by path.
+ * @registry: The registry to search.
+ * @path: The path the asset was loaded from.
+ * Return: The index of the asset, or -1 if it is not loaded.
+ * Description: A linear scan; a level only references a handful of files.
+ */
+static int find_asset(AssetRegistry *registry, const char *path)
+{
+	for (int i = 0; i < registry->count; i++)
+		if (strcmp(registry->assets[i]->path, path) == 0)
+			return (i);
+	return (-1);
+}
+
+/**
+ * queue_decode - Hands an asset to the loader threads.
+ * @registry: The registry owning the asset.
+ * @asset: The asset, showing the placeholder until the job is done.
+ */
+static void queue_decode(AssetRegistry *registry, Asset *asset)
+{
+	AssetJob *job = calloc(1, sizeof(AssetJob));
+
+	ASSERT(job, "Out of memory loading %s\n", asset->path);
+	job->asset = asset;
+	job->path = strdup(asset->path);
+	ASSERT(job->path, "Out of memory loading %s\n", asset->path);
+	asset->job = job;
+	asset->texels = registry->placeholder.texels;
+	asset->columns = registry->placeholder.columns;
+	asset->texture = registry->placeholder.texture;
+	registry->pending++;
+
+	SDL_LockMutex(registry->lock);
+	if (registry->queued)
+		registry->queuedTail->next = job;
+	else
+		registry->queued = job;
+	registry->queuedTail = job;
+	SDL_CondSignal(registry->wake);
+	SDL_UnlockMutex(registry->lock);
+}
+
+/**
+ * acquire_asset - Gets a shared handle to the asset stored at a path.
+ * @registry: The registry owning the asset.
+ * @path: The path of the image file.
+ * Return: The asset with one more reference.
+ * Description: The first acquire of an image the texture pack holds an
+ * up to date copy of uploads it straight from the pack. Any other image is
+ * queued to be decoded once, in the background, into CPU texels and their
+ * column-major mip chain; until poll_assets() uploads the GPU texture made
+ * from them, the asset shows the placeholder. Later acquires of the same
+ * path only bump the reference count.
+ */
+Asset *acquire_asset(AssetRegistry *registry, const char *path)
+{
+	int index = find_asset(registry, path);
+	Asset *asset;
+
+	if (index >= 0)
+		return (retain_asset(registry->assets[index]));
+
+	if (registry->count == registry->capacity)
+	{
+		int capacity = registry->capacity ? registry->capacity * 2 : 16;
+		Asset **assets = realloc(registry->assets, sizeof(Asset *) * capacity);
+
+		ASSERT(assets, "Out of memory loading %s\n", path);
+		registry->assets = assets;
+		registry->capacity = capacity;
+	}
+	asset = calloc(1, sizeof(Asset));
+	ASSERT(asset, "Out of memory loading %s\n", path);
+	asset->path = strdup(path);
+	ASSERT(asset->path, "Out of memory loading %s\n", path);
+	asset->refCount = 1;
+	if (find_packed_texture(&registry->pack, path, &asset->texels,
+		&asset->columns))
+	{
+		asset->packed = true;
+		asset->texture = upload_texels(registry->renderer, &asset->texels);
+		registry->revision++;
+	}
+	else
+		queue_decode(registry, asset);
+	registry->assets[registry->count++] = asset;
+	return (asset);
+}
+
+/**
+ * free_job - Releases a decode job and whatever it decoded.
+ * @job: The job, no longer on any list.
+ */
+static void free_job(AssetJob *job)
+{
+	if (job->texels.pixels)
+	{
+		free_texels(&job->texels);
+		free_column_mips(&job->columns);
+	}
+	free(job->path);
+	free(job);
+}
+
+/**
+ * poll_assets - Uploads an image the loader threads finished decoding.
+ * @registry: The registry.
+ * Return: true if an asset stopped showing the placeholder.
+ * Description: Called by the main thread once per frame. At most one
+ * texture is uploaded per call, so a burst of finished images is spread
+ * over several frames instead of stalling one. The program exits if an
+ * image could not be decoded, as it did when loading up front.
+ */
+bool poll_assets(AssetRegistry *registry)
+{
+	AssetJob *job;
+	Asset *asset;
+
+	if (registry->pending == 0)
+		return (false);
+	SDL_LockMutex(registry->lock);
+	job = registry->decoded;
+	if (job)
+		registry->decoded = job->next;
+	SDL_UnlockMutex(registry->lock);
+	if (!job)
+		return (false);
+	asset = job->asset;
+	if (!asset)
+	{
+		free_job(job);
+		return (false);
+	}
+	ASSERT(!job->failed, "Failed to load %s\n", job->path);
+	asset->texels = job->texels;
+	asset->columns = job->columns;
+	asset->texture = upload_texels(registry->renderer, &asset->texels);
+	asset->job = NULL;
+	job->texels.pixels = NULL;
+	free_job(job);
+	registry->pending--;
+	registry->revision++;
+	return (true);
+}
+
+/**
+ * wait_for_assets - Blocks until every acquired asset is loaded.
+ * @registry: The registry.
+ * Description: For tools and benchmarks that must not draw placeholders.
+ */
+void wait_for_assets(AssetRegistry *registry)
+{
+	while (registry->pending > 0)
+	{
+		SDL_LockMutex(registry->lock);
+		while (!registry->decoded)
+			SDL_CondWait(registry->done, registry->lock);
+		SDL_UnlockMutex(registry->lock);
+		poll_assets(registry);
+	}
+}
+
+/**
+ * retain_asset - Adds a reference to an asset handle.
+ * @asset: The asset, may be NULL.
+ * Return: @asset, so handles can be copied with a = retain_asset(b).
+ */
+Asset *retain_asset(Asset *asset)
+{
+	if (asset)
+		asset->refCount++;
+	return (asset);
+}
+
+/**
+ * free_asset - Releases the CPU and GPU memory of an asset.
+ * @registry: The registry owning the asset.
+ * @asset: The asset to free.
+ * Description: An asset still being decoded only holds the placeholder;
+ * its job is disowned and freed when it comes back from the loader. The
+ * pixels of a packed asset belong to the texture pack.
+ */
+static void free_asset(AssetRegistry *registry, Asset *asset)
+{
+	if (asset->job)
+	{
+		asset->job->asset = NULL;
+		registry->pending--;
+	}
+	else
+	{
+		if (asset->texture)
+			SDL_DestroyTexture(asset->texture);
+		if (!asset->packed)
+		{
+			free_texels(&asset->texels);
+			free_column_mips(&asset->columns);
+		}
+	}
+	free(asset->path);
+	free(asset);
+}
+
+/**
+ * release_asset - Drops a reference and frees the asset with the last one.
+ * @registry: The registry owning the asset.
+ * @asset: The asset, may be NULL.
+ */
+void release_asset(AssetRegistry *registry, Asset *asset)
+{
+	if (!asset || --asset->refCount > 0)
+		return;
+	for (int i = 0; i < registry->count; i++)
+	{
+		if (registry->assets[i] != asset)
+			continue;
+		registry->assets[i] = registry->assets[--registry->count];
+		break;
+	}
+	free_asset(registry, asset);
+}
+
+/**
+ * free_job_list - Frees every job of a list.
+ * @job: The first job of the list, may be NULL.
+ */
+static void free_job_list(AssetJob *job)
+{
+	while (job)
+	{
+		AssetJob *next = job->next;
+
+		free_job(job);
+		job = next;
+	}
+}
+
+/**
+ * destroy_asset_registry - Frees every asset still in the registry.
+ * @registry: The registry to destroy.
+ * Description: Called at shutdown, after the renderer's last frame and
+ * before the renderer itself is destroyed; outstanding handles become
+ * invalid. The loader threads finish the image they are decoding, if any,
+ * and exit first.
+ */
+void destroy_asset_registry(AssetRegistry *registry)
+{
+	SDL_LockMutex(registry->lock);
+	registry->quit = true;
+	SDL_CondBroadcast(registry->wake);
+	SDL_UnlockMutex(registry->lock);
+	for (int i = 0; i < ASSET_LOADERS; i++)
+		SDL_WaitThread(registry->loaders[i], NULL);
+	for (int i = 0; i < registry->count; i++)
+		free_asset(registry, registry->assets[i]);
+	free_job_list(registry->queued);
+	free_job_list(registry->decoded);
+	free(registry->assets);
+	close_texture_pack(&registry->pack);
+	SDL_DestroyTexture(registry->placeholder.texture);
+	free_texels(&registry->placeholder.texels);
+	free_column_mips(&registry->placeholder.columns);
+	SDL_DestroyCond(registry->wake);
+	SDL_DestroyCond(registry->done);
+	SDL_DestroyMutex(registry->lock);
+	memset(registry, 0, sizeof(*registry));
+}
@@ -0,0 +1,764 @@
+#include "../structure.h"
+#include <unistd.h>
+
+#define MIN_SECONDS 0.25
+#define DEFAULT_TOLERANCE 10.0
+
+/**
+ * struct BenchPose - A fixed camera the kernels are timed from
+ * @name: Name of the pose in the report
+ * @pos: Position of the player
+ * @angle: Viewing angle in radians, 0 looks along +x
+ */
+typedef struct BenchPose
+{
+	const char *name;
+	Vec2F pos;
+	float angle;
+} BenchPose;
+
+/**
+ * struct BenchResult - Timing of one benchmark case
+ * @name: Unique name of the case, used to match baselines
+ * @nsPerRay: Nanoseconds per ray (or per column for draw cases, per
+ * enemy for entity updates, per query for entity and batched ray queries,
+ * per image for startup cases)
+ * @raysPerSec: Rays (or columns, enemies, queries, images) per second
+ * @stepsPerRay: Average DDA steps (cells looked up) per ray, enemies found
+ * per query for entity queries, 0 for the other cases
+ * @msPerFrame: Milliseconds per frame of rays (or columns), per update
+ * step or per query for entity cases, per batch for batched ray queries,
+ * per startup for startup cases
+ */
+typedef struct BenchResult
+{
+	char name[96];
+	double nsPerRay;
+	double raysPerSec;
+	double stepsPerRay;
+	double msPerFrame;
+} BenchResult;
+
+static const BenchPose poses[] = {
+	{"spawn", {4.0f, 4.0f}, PI},
+	{"open_room", {1.5f, 14.5f}, -PI / 4},
+	{"corridor", {14.5f, 1.5f}, PI / 2},
+	{"facing_wall", {7.5f, 4.5f}, PI / 2},
+};
+
+/* Poses on the open field generated by make_open_field() */
+static const BenchPose openPoses[] = {
+	{"open_field", {512.5f, 512.5f}, 0.3f},
+	{"open_field_diagonal", {40.5f, 40.5f}, PI / 4},
+};
+
+static const int widths[] = {320, 640, 1280, 1920, 3840};
+
+/* Enemy counts of the entity cases, on a 256x256 open field */
+static const int entityCounts[] = {1000, 10000};
+
+/* Queries per batch of the batched ray cases */
+#define RAY_BATCH 100000
+
+/* The images initialize_sdl() acquires, timed by the startup cases */
+static const char *const startupImages[] = {
+	"./texture/stone_wall_texture.jpg", "./texture/wild_grass.jpg",
+	"./texture/weapon_1.png", "./texture/enemy_1.png",
+};
+
+/**
+ * enum DdaMode - Which DDA kernel a cast case runs
+ * @DdaScalar: perform_dda() stepping one cell at a time
+ * @DdaDistanceField: perform_dda() skipping empty space with the field
+ * @DdaAvx2: perform_dda_avx2() on groups of 8 rays
+ */
+typedef enum DdaMode
+{
+	DdaScalar, DdaDistanceField, DdaAvx2
+} DdaMode;
+
+static const char *const ddaModeNames[] = {"scalar", "scalar+df", "avx2"};
+
+/**
+ * struct BenchHit - Where the ray of one column ended
+ * @mapBox: The wall cell that was hit
+ * @sideDist: The distances to the next grid lines after the hit
+ * @side: Which side of the wall was hit
+ * @distance: The perpendicular wall distance
+ */
+typedef struct BenchHit
+{
+	Vec2I mapBox;
+	Vec2F sideDist;
+	Side side;
+	float distance;
+} BenchHit;
+
+/**
+ * enum DrawMode - How a draw case puts the wall columns on screen
+ * @DrawColumns: One SDL_RenderCopy per column with render_column()
+ * @DrawGeometry: Batched wall spans with render_walls()
+ * @DrawSoftware: Into a CPU framebuffer with draw_column_software()
+ */
+typedef enum DrawMode
+{
+	DrawColumns, DrawGeometry, DrawSoftware
+} DrawMode;
+
+static const char *const drawModeNames[] = {"sdl", "geometry", "software"};
+
+/* Accumulates results so the timed work cannot be optimized away */
+static volatile float benchSink;
+
+/**
+ * pose_player - Builds the Player looking from a benchmark pose.
+ * @pose: The pose to use.
+ * Return: The player, with the same FOV as initialize_player().
+ */
+static Player pose_player(const BenchPose *pose)
+{
+	Player player = {
+		.pos = pose->pos,
+		.dir = {cosf(pose->angle), sinf(pose->angle)},
+		.plane = {-sinf(pose->angle) * 0.66f, cosf(pose->angle) * 0.66f},
+	};
+	return (player);
+}
+
+/**
+ * ray_for_column - Computes the ray of a column for an arbitrary width.
+ * @player: The player the ray starts from.
+ * @x: The column.
+ * @width: The number of columns.
+ * Return: The direction of the ray.
+ */
+static Vec2F ray_for_column(const Player *player, int x, int width)
+{
+	float cameraX = 2 * x / (float)width - 1;
+
+	return ((Vec2F) {player->dir.x + player->plane.x * cameraX,
+		player->dir.y + player->plane.y * cameraX});
+}
+
+/**
+ * cast_frame - Casts one frame of rays and counts DDA steps.
+ * @player: The player the rays start from.
+ * @width: The number of columns.
+ * @simd: Whether to use the AVX2 kernel for groups of 8 columns.
+ * @map: the map to cast against; its distance field is used if it has one.
+ * @hits: Where the hit of every column is stored, or NULL.
+ * Return: The number of cells looked up. The AVX2 kernel looks up every
+ * cell it moves through, the Manhattan distance between start and hit.
+ */
+static long cast_frame(Player *player, int width, bool simd,
+	const Map *map, BenchHit *hits)
+{
+	Vec2F rayDir[8], sideDist[8], deltaDist[8];
+	Vec2I mapBox[8], stepDir[8];
+	Side side[8];
+	Vec2I start = {(int)player->pos.x, (int)player->pos.y};
+	long steps = 0;
+	float sum = 0.0f;
+
+	for (int x = 0; x < width; x += 8)
+	{
+		int lanes = MIN(8, width - x);
+
+		for (int i = 0; i < lanes; i++)
+		{
+			rayDir[i] = ray_for_column(player, x + i, width);
+			sideDist[i] = (Vec2F) {0.0f, 0.0f};
+			initialize_raycasting(player, rayDir[i],
+				&mapBox[i], &sideDist[i], &deltaDist[i], &stepDir[i]);
+		}
+		if (simd && lanes == 8)
+		{
+			perform_dda_avx2(mapBox, sideDist, deltaDist, stepDir, side, map);
+			for (int i = 0; i < lanes; i++)
+				steps += abs(mapBox[i].x - start.x) +
+					abs(mapBox[i].y - start.y);
+		}
+		else
+			for (int i = 0; i < lanes; i++)
+				steps += perform_dda(&mapBox[i], &sideDist[i], &deltaDist[i],
+					&stepDir[i], &side[i], map);
+		for (int i = 0; i < lanes; i++)
+		{
+			float distance = calculate_wall_distance(side[i],
+				&sideDist[i], &deltaDist[i]);
+
+			sum += distance;
+			if (hits)
+				hits[x + i] = (BenchHit) {mapBox[i],
+					sideDist[i], side[i], distance};
+		}
+	}
+	benchSink += sum;
+	return (steps);
+}
+
+/**
+ * seconds_since - Converts a performance counter interval to seconds.
+ * @start: The counter value at the start of the interval.
+ * Return: The seconds elapsed since @start.
+ */
+static double seconds_since(Uint64 start)
+{
+	return ((double)(SDL_GetPerformanceCounter() - start) /
+		SDL_GetPerformanceFrequency());
+}
+
+/**
+ * kernel_view - Gives a DDA kernel the map the way it is meant to see it.
+ * @map: The map.
+ * @mode: The kernel.
+ * Return: A shallow copy of @map, without its distance field unless
+ * @mode is the one that skips empty space with it.
+ */
+static Map kernel_view(const Map *map, DdaMode mode)
+{
+	Map view = *map;
+
+	if (mode != DdaDistanceField)
+		view.distance = NULL;
+	return (view);
+}
+
+/**
+ * same_hit - Compares two hits bit for bit.
+ * @a: The first hit.
+ * @b: The second hit.
+ * Return: true if the wall cell, side, sideDist and distance are equal.
+ */
+static bool same_hit(const BenchHit *a, const BenchHit *b)
+{
+	return (a->mapBox.x == b->mapBox.x && a->mapBox.y == b->mapBox.y &&
+		a->side == b->side && a->sideDist.x == b->sideDist.x &&
+		a->sideDist.y == b->sideDist.y && a->distance == b->distance);
+}
+
+/**
+ * check_kernels - Checks that two DDA kernels find the same hits.
+ * @posesToCheck: The poses to cast from.
+ * @count: The number of poses.
+ * @map: the map to cast against.
+ * @a: The kernel the other one must match.
+ * @b: The kernel being checked.
+ * Return: The number of columns where the hits differ; each is reported.
+ * Description: Every column of every pose is cast at every benchmarked
+ * width, and the wall cell, side, sideDist and wall distance are compared
+ * bit for bit.
+ */
+static int check_kernels(const BenchPose *posesToCheck, int count,
+	const Map *map, DdaMode a, DdaMode b)
+{
+	int numWidths = sizeof(widths) / sizeof(widths[0]), mismatches = 0;
+	int maxWidth = widths[numWidths - 1];
+	BenchHit *hitsA = malloc(sizeof(BenchHit) * maxWidth);
+	BenchHit *hitsB = malloc(sizeof(BenchHit) * maxWidth);
+	Map viewA = kernel_view(map, a), viewB = kernel_view(map, b);
+
+	ASSERT(hitsA && hitsB, "Out of memory\n");
+	for (int p = 0; p < count; p++)
+		for (int w = 0; w < numWidths; w++)
+		{
+			Player player = pose_player(&posesToCheck[p]);
+			int width = widths[w];
+
+			cast_frame(&player, width, a == DdaAvx2, &viewA, hitsA);
+			cast_frame(&player, width, b == DdaAvx2, &viewB, hitsB);
+			for (int x = 0; x < width; x++)
+			{
+				if (same_hit(&hitsA[x], &hitsB[x]))
+					continue;
+				fprintf(stderr, "%s differs from %s: %s/%d "
+					"column %d\n", ddaModeNames[b],
+					ddaModeNames[a], posesToCheck[p].name,
+					width, x);
+				mismatches++;
+			}
+		}
+	free(hitsA);
+	free(hitsB);
+	return (mismatches);
+}
+
+/**
+ * bench_cast - Times the raycasting kernels for one pose and width.
+ * @pose: The pose to cast from.
+ * @width: The number of rays per frame.
+ * @mode: The DDA kernel to time.
+ * @map: the map to cast against.
+ * @result: Where the timing is stored.
+ */
+static void bench_cast(const BenchPose *pose, int width, DdaMode mode,
+	const Map *map, BenchResult *result)
+{
+	Player player = pose_player(pose);
+	long frames = 0, steps = 0;
+	double elapsed;
+	Uint64 start;
+	bool simd = mode == DdaAvx2;
+	Map view = kernel_view(map, mode);
+
+	map = &view;
+	cast_frame(&player, width, simd, map, NULL);
+	start = SDL_GetPerformanceCounter();
+	do {
+		steps += cast_frame(&player, width, simd, map, NULL);
+		frames++;
+	} while ((elapsed = seconds_since(start)) < MIN_SECONDS);
+
+	snprintf(result->name, sizeof(result->name), "cast/%s/%s/%d",
+		ddaModeNames[mode], pose->name, width);
+	result->nsPerRay = elapsed * 1e9 / ((double)frames * width);
+	result->raysPerSec = (double)frames * width / elapsed;
+	result->stepsPerRay = (double)steps / ((double)frames * width);
+	result->msPerFrame = elapsed * 1e3 / frames;
+}
+
+/**
+ * make_open_field - Builds a large open test map.
+ * @map: Where the map is stored; free it with free_map().
+ * @size: The width and height of the map.
+ * Description: Walled in, with a pillar every 128 cells, so most rays
+ * cross long stretches of empty space.
+ */
+static void make_open_field(Map *map, int size)
+{
+	ASSERT(init_map(map, size, size), "Failed to create the open field\n");
+	for (int i = 0; i < size; i++)
+	{
+		set_map_tile(map, i, 0, 1);
+		set_map_tile(map, i, size - 1, 1);
+		set_map_tile(map, 0, i, 1);
+		set_map_tile(map, size - 1, i, 1);
+	}
+	for (int y = 64; y < size; y += 128)
+		for (int x = 64; x < size; x += 128)
+			set_map_tile(map, x, y, 1);
+	ASSERT(build_distance_field(map), "Out of memory\n");
+}
+
+/**
+ * bench_draw - Times drawing one frame of wall columns.
+ * @state: The initialized State holding the renderer and textures.
+ * @pose: The pose whose hits are drawn.
+ * @mode: How the columns are drawn.
+ * @map: the map the hits were cast against.
+ * @result: Where the timing is stored.
+ */
+static void bench_draw(State *state, const BenchPose *pose, DrawMode mode,
+	const Map *map, BenchResult *result)
+{
+	Player player = pose_player(pose);
+	uint32_t *pixels = calloc(SCREEN_W * SCREEN_H, sizeof(uint32_t));
+	long frames = 0;
+	double elapsed;
+	Uint64 start;
+
+	ASSERT(pixels, "Out of memory\n");
+	cast_columns(state, &player, map);
+	start = SDL_GetPerformanceCounter();
+	do {
+		for (int x = 0; mode != DrawGeometry && x < SCREEN_W; x++)
+		{
+			const ColumnHit *hit = &state->columnHits[x];
+			const ColumnMips *mips = &state->wallTiles[map_tile(map,
+				hit->mapBox.x, hit->mapBox.y)]->columns;
+
+			if (mode == DrawSoftware)
+				draw_column_software(pixels,
+					SCREEN_W * sizeof(uint32_t), SCREEN_H,
+					x, (int)(SCREEN_H / hit->distance),
+					state->colormap[wall_light(hit)], mips,
+					hit->wallX);
+			else
+				render_column(state, x, hit, map);
+		}
+		if (mode == DrawGeometry)
+			render_walls(state, map);
+		if (mode != DrawSoftware)
+			SDL_RenderPresent(state->renderer);
+		frames++;
+	} while ((elapsed = seconds_since(start)) < MIN_SECONDS);
+	free(pixels);
+
+	snprintf(result->name, sizeof(result->name), "draw/%s/%s/%d",
+		drawModeNames[mode], pose->name, SCREEN_W);
+	result->nsPerRay = elapsed * 1e9 / ((double)frames * SCREEN_W);
+	result->raysPerSec = (double)frames * SCREEN_W / elapsed;
+	result->stepsPerRay = 0.0;
+	result->msPerFrame = elapsed * 1e3 / frames;
+}
+
+/**
+ * bench_entities - Times moving and querying a crowd of enemies.
+ * @map: The map the enemies are scattered over and collide with.
+ * @count: The number of enemies.
+ * @results: Where the timings of the update and query cases are stored.
+ * Description: An update step moves every enemy once along a flow field
+ * toward the middle of the map, as one simulation step does; a query looks
+ * for the enemies within maxDepth of a random point, as selecting the
+ * sprites of a frame does.
+ */
+static void bench_entities(const Map *map, int count, BenchResult *results)
+{
+	EntityPool pool;
+	FlowField flow;
+	int *found = malloc(sizeof(int) * count);
+	unsigned int seed = 1;
+	double elapsed;
+	long steps = 0, queries = 0, hits = 0;
+	Uint64 start;
+
+	ASSERT(found, "Out of memory\n");
+	init_entity_pool(&pool);
+	pool.speeds[EntityEnemy] = ENEMY_SPEED;
+	scatter_entities(&pool, map, EntityEnemy, count);
+	init_flow_field(&flow);
+	do {
+		update_flow_field(&flow, map,
+			(Vec2I) {map->width / 2 + 1, map->height / 2 + 1});
+	} while (flow.busy);
+	update_entities(&pool, map, &flow, SIM_DT);
+
+	start = SDL_GetPerformanceCounter();
+	do {
+		update_entities(&pool, map, &flow, SIM_DT);
+		steps++;
+	} while ((elapsed = seconds_since(start)) < MIN_SECONDS);
+	snprintf(results[0].name, sizeof(results[0].name), "entities/update/%d",
+		count);
+	results[0].nsPerRay = elapsed * 1e9 / ((double)steps * pool.count);
+	results[0].raysPerSec = (double)steps * pool.count / elapsed;
+	results[0].stepsPerRay = 0.0;
+	results[0].msPerFrame = elapsed * 1e3 / steps;
+
+	start = SDL_GetPerformanceCounter();
+	do {
+		Vec2F center = {rand_r(&seed) % map->width + 0.5f,
+			rand_r(&seed) % map->height + 0.5f};
+
+		hits += query_entities(&pool, center, maxDepth, found, count);
+		queries++;
+	} while ((elapsed = seconds_since(start)) < MIN_SECONDS);
+	benchSink += hits;
+	snprintf(results[1].name, sizeof(results[1].name), "entities/query/%d",
+		count);
+	results[1].nsPerRay = elapsed * 1e9 / queries;
+	results[1].raysPerSec = queries / elapsed;
+	results[1].stepsPerRay = (double)hits / queries;
+	results[1].msPerFrame = elapsed * 1e3 / queries;
+	free_entity_pool(&pool, NULL);
+	free_flow_field(&flow);
+	free(found);
+}
+
+/**
+ * random_empty_point - Picks the center of a random empty cell.
+ * @map: The map.
+ * @seed: State of rand_r().
+ * Return: The point.
+ */
+static Vec2F random_empty_point(const Map *map, unsigned int *seed)
+{
+	int x, y;
+
+	do {
+		x = rand_r(seed) % map->width;
+		y = rand_r(seed) % map->height;
+	} while (map_solid(map, x, y));
+	return ((Vec2F) {x + 0.5f, y + 0.5f});
+}
+
+/**
+ * bench_rays - Times batched line of sight and ray queries.
+ * @pool: The thread pool the batches are spread over.
+ * @map: The map the rays are traced through.
+ * @label: Name of the map in the report.
+ * @results: Where the timings of the los and cast cases are stored.
+ * Description: Each query goes from a random empty cell to another one at
+ * most maxDepth away, as an enemy checking whether it sees the player.
+ */
+static void bench_rays(ThreadPool *pool, const Map *map, const char *label,
+	BenchResult *results)
+{
+	RayQuery *rays = malloc(sizeof(RayQuery) * RAY_BATCH);
+	RayHit *hits = malloc(sizeof(RayHit) * RAY_BATCH);
+	bool *blocked = malloc(sizeof(bool) * RAY_BATCH);
+	unsigned int seed = 1;
+
+	ASSERT(rays && hits && blocked, "Out of memory\n");
+	for (int i = 0; i < RAY_BATCH; i++)
+	{
+		Vec2F from = random_empty_point(map, &seed), to;
+
+		do {
+			to = (Vec2F) {from.x + rand_r(&seed) % 41 - 20,
+				from.y + rand_r(&seed) % 41 - 20};
+		} while (map_solid(map, (int)to.x, (int)to.y));
+		rays[i].origin = from;
+		rays[i].dir = (Vec2F) {to.x - from.x, to.y - from.y};
+		rays[i].maxDistance = sqrtf(rays[i].dir.x * rays[i].dir.x +
+			rays[i].dir.y * rays[i].dir.y);
+		if (rays[i].maxDistance > maxDepth)
+			rays[i].maxDistance = maxDepth;
+	}
+	for (int kind = 0; kind < 2; kind++)
+	{
+		long batches = 0, blockedCount = 0;
+		double elapsed;
+		Uint64 start = SDL_GetPerformanceCounter();
+
+		do {
+			if (kind == 0)
+				test_occlusion(pool, map, rays, RAY_BATCH, blocked);
+			else
+				cast_rays(pool, map, rays, RAY_BATCH, hits);
+			batches++;
+		} while ((elapsed = seconds_since(start)) < MIN_SECONDS);
+		for (int i = 0; i < RAY_BATCH; i++)
+			blockedCount += kind == 0 ? blocked[i] : hits[i].hit;
+		benchSink += blockedCount;
+		snprintf(results[kind].name, sizeof(results[kind].name),
+			"rays/%s/%s/%d", kind == 0 ? "los" : "cast", label, RAY_BATCH);
+		results[kind].nsPerRay = elapsed * 1e9 / ((double)batches * RAY_BATCH);
+		results[kind].raysPerSec = (double)batches * RAY_BATCH / elapsed;
+		results[kind].stepsPerRay = 0.0;
+		results[kind].msPerFrame = elapsed * 1e3 / batches;
+	}
+	free(rays);
+	free(hits);
+	free(blocked);
+}
+
+/**
+ * bench_startup - Times loading the game's images into a new registry.
+ * @renderer: The renderer the images are uploaded to.
+ * @pack: The texture pack to load them from, NULL to decode them all.
+ * @result: Where the timing is stored.
+ * Description: Each startup creates an asset registry, acquires the
+ * images initialize_sdl() does and waits until all of them are on the
+ * GPU. The files stay in the page cache between startups, so this is the
+ * cost of a warm start.
+ */
+static void bench_startup(SDL_Renderer *renderer, const char *pack,
+	BenchResult *result)
+{
+	int images = sizeof(startupImages) / sizeof(startupImages[0]);
+	AssetRegistry registry;
+	long startups = 0;
+	double elapsed = 0.0;
+
+	do {
+		Uint64 start = SDL_GetPerformanceCounter();
+
+		init_asset_registry(&registry, renderer);
+		/* Whatever pack the game would map is swapped for the one timed */
+		close_texture_pack(&registry.pack);
+		if (pack)
+			open_texture_pack(pack, &registry.pack);
+		for (int i = 0; i < images; i++)
+			acquire_asset(&registry, startupImages[i]);
+		wait_for_assets(&registry);
+		elapsed += seconds_since(start);
+		destroy_asset_registry(&registry);
+		startups++;
+	} while (elapsed < MIN_SECONDS);
+
+	snprintf(result->name, sizeof(result->name), "startup/%s/%d",
+		pack ? "pack" : "decode", images);
+	result->nsPerRay = elapsed * 1e9 / ((double)startups * images);
+	result->raysPerSec = (double)startups * images / elapsed;
+	result->stepsPerRay = 0.0;
+	result->msPerFrame = elapsed * 1e3 / startups;
+}
+
+/**
+ * write_json - Writes the results as JSON, one case per line.
+ * @out: The stream to write to.
+ * @results: The results.
+ * @count: The number of results.
+ */
+static void write_json(FILE *out, const BenchResult *results, int count)
+{
+	fprintf(out, "{\"results\": [\n");
+	for (int i = 0; i < count; i++)
+		fprintf(out, "{\"name\": \"%s\", \"ns_per_ray\": %.3f, "
+			"\"rays_per_sec\": %.0f, \"steps_per_ray\": %.3f, "
+			"\"ms_per_frame\": %.4f}%s\n",
+			results[i].name, results[i].nsPerRay, results[i].raysPerSec,
+			results[i].stepsPerRay, results[i].msPerFrame,
+			i + 1 < count ? "," : "");
+	fprintf(out, "]}\n");
+}
+
+/**
+ * compare_baseline - Compares the results against a stored baseline.
+ * @path: The baseline written earlier by --output.
+ * @results: The results of this run.
+ * @count: The number of results.
+ * @tolerance: Allowed slowdown in percent before a case counts as a
+ * regression.
+ * Return: The number of regressed cases, or -1 if the baseline is missing,
+ * unreadable or shares no case with this run.
+ */
+static int compare_baseline(const char *path, const BenchResult *results,
+	int count, double tolerance)
+{
+	FILE *file = fopen(path, "r");
+	char line[512], name[96];
+	double ns;
+	int regressions = 0, matched = 0;
+
+	if (!file)
+	{
+		fprintf(stderr, "No baseline at %s\n", path);
+		return (-1);
+	}
+	while (fgets(line, sizeof(line), file))
+	{
+		if (sscanf(line, "{\"name\": \"%95[^\"]\", \"ns_per_ray\": %lf",
+			name, &ns) != 2)
+			continue;
+		for (int i = 0; i < count; i++)
+		{
+			if (strcmp(results[i].name, name) != 0)
+				continue;
+			double change = (results[i].nsPerRay - ns) / ns * 100.0;
+
+			fprintf(stderr, "%-36s %9.2f -> %9.2f ns %+7.1f%%%s\n", name, ns,
+				results[i].nsPerRay, change,
+				change > tolerance ? "  REGRESSION" : "");
+			regressions += change > tolerance;
+			matched++;
+		}
+	}
+	if (ferror(file) || matched == 0)
+	{
+		fprintf(stderr, "No usable baseline in %s\n", path);
+		regressions = -1;
+	}
+	fclose(file);
+	return (regressions);
+}
+
+/**
+ * main - Runs the raycasting microbenchmarks without a visible display.
+ * @argc: The number of command line arguments.
+ * @argv: [--map FILE] [--output FILE] [--baseline FILE] [--tolerance PCT]
+ * Return: 0 on success, 1 on bad usage, if the distance field or the AVX2
+ * kernel changes any hit of the scalar DDA, if any case regressed or if
+ * the baseline cannot be used.
+ */
+int main(int argc, char **argv)
+{
+	const char *mapPath = "map_1", *output = NULL, *baseline = NULL;
+	double tolerance = DEFAULT_TOLERANCE;
+	Map map, openField;
+	int numOpenPoses = sizeof(openPoses) / sizeof(openPoses[0]);
+	int numPoses = sizeof(poses) / sizeof(poses[0]);
+	int numWidths = sizeof(widths) / sizeof(widths[0]);
+	BenchResult results[256];
+	int count = 0;
+	static State state = {.renderMode = RenderSoftware, .numThreads = 1};
+	ThreadPool *rayPool;
+	char packPath[] = "/tmp/bench_startup_XXXXXX";
+	int fd;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+			mapPath = argv[++i];
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+			baseline = argv[++i];
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+			tolerance = atof(argv[++i]);
+		else
+		{
+			fprintf(stderr, "Usage: %s [--map FILE] [--output FILE] "
+				"[--baseline FILE] [--tolerance PCT]\n", argv[0]);
+			return (1);
+		}
+	}
+	if (!load_map(mapPath, &map))
+		return (1);
+	/* Skipping space and stepping 8 rays together must not change a hit */
+	if (check_kernels(poses, numPoses, &map, DdaScalar,
+		DdaDistanceField) != 0 || (dda_avx2_supported() &&
+		check_kernels(poses, numPoses, &map, DdaScalar, DdaAvx2) != 0))
+		return (1);
+
+	make_open_field(&openField, 256);
+	for (int i = 0; i < (int)(sizeof(entityCounts) / sizeof(entityCounts[0])); i++)
+	{
+		bench_entities(&openField, entityCounts[i], &results[count]);
+		count += 2;
+	}
+	free_map(&openField);
+
+	make_open_field(&openField, 1024);
+	if (check_kernels(openPoses, numOpenPoses, &openField, DdaScalar,
+		DdaDistanceField) != 0)
+		return (1);
+	rayPool = create_thread_pool(SDL_GetCPUCount());
+	bench_rays(rayPool, &map, "map", &results[count]);
+	bench_rays(rayPool, &openField, "open_field", &results[count + 2]);
+	count += 4;
+	destroy_thread_pool(rayPool);
+	for (int mode = DdaScalar; mode <= DdaAvx2; mode++)
+	{
+		if (mode == DdaAvx2 && !dda_avx2_supported())
+			break;
+		for (int p = 0; p < numPoses; p++)
+			for (int w = 0; w < numWidths; w++)
+				bench_cast(&poses[p], widths[w], mode, &map,
+					&results[count++]);
+		for (int p = 0; p < numOpenPoses; p++)
+			for (int w = 0; w < numWidths; w++)
+				bench_cast(&openPoses[p], widths[w], mode, &openField,
+					&results[count++]);
+	}
+	free_map(&openField);
+
+	/* The draw stage goes through SDL's offscreen driver, no display needed */
+	SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+	if (SDL_Init(SDL_INIT_VIDEO) != 0)
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+	SDL_Quit();
+	initialize_sdl(&state);
+	wait_for_assets(&state.assets);
+	for (int p = 0; p < numPoses; p++)
+		for (int mode = DrawColumns; mode <= DrawSoftware; mode++)
+			bench_draw(&state, &poses[p], mode, &map, &results[count++]);
+	bench_startup(state.renderer, NULL, &results[count++]);
+	fd = mkstemp(packPath);
+	if (fd >= 0)
+	{
+		close(fd);
+		if (save_texture_pack(packPath, (char **)startupImages,
+			sizeof(startupImages) / sizeof(startupImages[0])))
+			bench_startup(state.renderer, packPath, &results[count++]);
+		remove(packPath);
+	}
+	destroy_thread_pool(state.pool);
+	SDL_Quit();
+	free_map(&map);
+
+	write_json(stdout, results, count);
+	if (output)
+	{
+		FILE *file = fopen(output, "w");
+
+		ASSERT(file, "Failed to open %s for writing\n", output);
+		write_json(file, results, count);
+		fclose(file);
+	}
+	/* A missing or unusable baseline fails the gate like a regression */
+	if (baseline && compare_baseline(baseline, results, count, tolerance) != 0)
+		return (1);
+	return (0);
+}
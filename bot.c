@@ -1,33 +1,160 @@
 #include "structure.h"
 
 /**
- * handle_enemies - Manages the spawning of enemies in the game.
+ * handle_enemies - Spawns and moves the enemies of the game.
  * @state: Pointer to the game state structure containing all relevant data.
+ * @map: The map, whose enemy spawn points are used in turn.
+ * @player: The player the enemies chase.
  *
- * Description: This function checks if enough time has passed since the last
- * enemy spawn (30 seconds) and spawns a new enemy if there are fewer than 10
- * enemies in the game.
- * The enemy is placed at a fixed position, and its texture
- * is loaded from a file.
- * The enemy spawn timer is reset after an enemy is added.
+ * Description: Every 3 seconds of simulated time a new enemy is spawned
+ * while fewer than ENEMY_SPAWN_LIMIT are alive. The enemy is placed at
+ * the next spawn point of the map, or in a random empty cell when the map
+ * has none, and shares the already decoded enemy sprite of its type, so
+ * spawning never touches the disk. The flow field is brought up to date
+ * with the player's cell and every enemy then moves by one step along it;
+ * both are skipped until there is an enemy.
  *
  * Return: None
  */
-void handle_enemies(State *state)
+void handle_enemies(State *state, const Map *map, const Player *player)
 {
-	Uint32 currentTime = SDL_GetTicks();
+	Uint32 currentTime = (Uint32)(state->simSteps * 1000 / SIM_HZ);
+	EntityPool *enemies = &state->enemies;
 
 	if (currentTime - state->enemySpawnTimer >= 3000)
 	{
-		if (state->numEnemies < 10)
+		if (enemies->count < ENEMY_SPAWN_LIMIT && map->numEnemySpawns)
+			spawn_entity(enemies, EntityEnemy,
+				map->enemySpawns[enemies->count % map->numEnemySpawns]);
+		else if (enemies->count < ENEMY_SPAWN_LIMIT)
+			scatter_entities(enemies, map, EntityEnemy, 1);
+		state->enemySpawnTimer = currentTime;
+	}
+	/* Nobody follows the field until the first enemy spawns */
+	if (enemies->count == 0)
+		return;
+	update_flow_field(&state->flow, map,
+		(Vec2I) {(int)player->pos.x, (int)player->pos.y});
+	update_entities(enemies, map, &state->flow, SIM_DT);
+}
+
+/**
+ * compare_depth - Orders sprite projections from far to near for qsort.
+ * @a: The first SpriteProjection.
+ * @b: The second SpriteProjection.
+ * Return: Negative if @a is farther than @b, positive if nearer, else 0.
+ */
+static int compare_depth(const void *a, const void *b)
+{
+	float da = ((const SpriteProjection *)a)->depth;
+	float db = ((const SpriteProjection *)b)->depth;
+
+	return ((da < db) - (da > db));
+}
+
+/**
+ * reserve_sprites - Makes room to project every enemy.
+ * @state: Pointer to the State owning the buffers.
+ * Description: The buffers follow the capacity of the enemy pool; the
+ * program exits if memory runs out.
+ */
+static void reserve_sprites(State *state)
+{
+	int capacity = state->enemies.capacity;
+
+	if (capacity <= state->spriteCapacity)
+		return;
+	state->sprites = realloc(state->sprites,
+		sizeof(SpriteProjection) * capacity);
+	state->nearby = realloc(state->nearby, sizeof(int) * capacity);
+	ASSERT(state->sprites && state->nearby,
+		"Out of memory for %d sprites\n", capacity);
+	state->spriteCapacity = capacity;
+}
+
+/**
+ * hash_sprites - Hashes what the visible projections would draw.
+ * @sprites: The projections, sorted far to near.
+ * @count: The number of projections.
+ * Return: The hash; only the fields drawing depends on are folded in.
+ */
+static uint64_t hash_sprites(const SpriteProjection *sprites, int count)
+{
+	uint64_t hash = HASH_INIT;
+
+	for (int i = 0; i < count; i++)
+	{
+		hash = hash_bytes(hash, &sprites[i].sprite, sizeof(sprites[i].sprite));
+		hash = hash_bytes(hash, &sprites[i].depth, sizeof(sprites[i].depth));
+		hash = hash_bytes(hash, &sprites[i].startX, sizeof(sprites[i].startX));
+		hash = hash_bytes(hash, &sprites[i].size, sizeof(sprites[i].size));
+		hash = hash_bytes(hash, &sprites[i].firstVisible,
+			sizeof(sprites[i].firstVisible));
+		hash = hash_bytes(hash, &sprites[i].lastVisible,
+			sizeof(sprites[i].lastVisible));
+	}
+	return (hash);
+}
+
+/**
+ * project_enemies - Projects the enemies and keeps the ones that are visible
+ * @state: Pointer to the State holding the enemies and this frame's hits.
+ * @player: Pointer to the Player structure the view is rendered from.
+ * Return: The number of visible projections stored in state->sprites,
+ * sorted far to near.
+ * Description: Only enemies the spatial hash finds within maxDepth are
+ * considered; farther ones are faded to black anyway. They are moved into
+ * camera space with the inverse of the [plane dir] matrix. Every column
+ * the sprite covers is then tested against the wall distance in
+ * state->columnHits, so sprites that are behind the camera, off screen or
+ * completely hidden by walls never reach a draw call. A hash of the result
+ * is left in state->spriteHash for the scene cache.
+ */
+int project_enemies(State *state, Player *player)
+{
+	const EntityPool *enemies = &state->enemies;
+	float invDet = 1.0f / (player->plane.x * player->dir.y -
+		player->dir.x * player->plane.y);
+	int count = 0, nearby;
+
+	reserve_sprites(state);
+	nearby = query_entities(enemies, player->pos, maxDepth, state->nearby,
+		state->spriteCapacity);
+	for (int n = 0; n < nearby; n++)
+	{
+		int i = state->nearby[n];
+		Vec2F rel = {enemies->posX[i] - player->pos.x,
+			enemies->posY[i] - player->pos.y};
+		float transformX = invDet * (player->dir.y * rel.x - player->dir.x * rel.y);
+		float depth = invDet * (-player->plane.y * rel.x + player->plane.x * rel.y);
+		SpriteProjection *sprite = &state->sprites[count];
+
+		if (depth <= 0.1f)
+			continue;
+		sprite->entity = i;
+		sprite->sprite = enemies->sprites[enemies->type[i]];
+		sprite->depth = depth;
+		sprite->size = abs((int)(state->viewH / depth));
+		sprite->startX = (int)((state->viewW / 2) *
+			(1 + transformX / depth)) - sprite->size / 2;
+		sprite->firstVisible = -1;
+		for (int x = MAX(sprite->startX, 0);
+			x < MIN(sprite->startX + sprite->size, state->viewW); x++)
 		{
-			state->enemies[state->numEnemies].pos = (Vec2F) {5, 5};
-			state->enemies[state->numEnemies].texture = load_texture(state->renderer,
-				"./texture/enemy_1.png");
-			state->numEnemies++;
+			if (depth >= state->columnHits[x].distance)
+				continue;
+			if (sprite->firstVisible < 0)
+				sprite->firstVisible = x;
+			sprite->lastVisible = x;
 		}
-		state->enemySpawnTimer = currentTime;
+		if (sprite->firstVisible >= 0 && sprite->sprite)
+			count++;
 	}
+	if (count > 1)
+		qsort(state->sprites, count, sizeof(SpriteProjection),
+			compare_depth);
+	state->spriteHash = hash_sprites(state->sprites, count);
+	return (count);
 }
 
 /**
@@ -35,44 +162,99 @@ void handle_enemies(State *state)
  * @state: Pointer to the State structure containing the SDL renderer.
  * @player: Pointer to the Player structure containing player information.
  * Return: None
+ * Description: Must run after the walls, once state->columnHits holds this
+ * frame's wall distances. Each run of adjacent columns where a sprite is in
+ * front of the wall is drawn with a single SDL_RenderCopy, lit for the
+ * sprite's distance through its texture color.
  */
 void render_enemies(State *state, Player *player)
 {
-	for (int i = 0; i < state->numEnemies; i++)
-	{
-		Enemy *enemy = &state->enemies[i];
+	int count = project_enemies(state, player);
 
-		/* Calculate the relative position of the enemy */
-		Vec2F enemyRel = {
-			.x = enemy->pos.x - player->pos.x,
-			.y = enemy->pos.y - player->pos.y
-		};
+	for (int i = 0; i < count; i++)
+	{
+		SpriteProjection *sprite = &state->sprites[i];
+		int texW, texH, runStart = -1;
 
-		/* Calculate the angle of the enemy relative to the player's pov */
-		float angle = atan2f(enemyRel.y, enemyRel.x) -
-			atan2f(player->dir.y, player->dir.x);
-		float distance = sqrtf(enemyRel.x * enemyRel.x + enemyRel.y * enemyRel.y);
+		SDL_Texture *texture = sprite->sprite->texture;
+		Uint8 light = state->colormap[light_level(LIGHT_FULL,
+			sprite->depth)][255];
 
-		/* Check if the enemy is within the player's field of view */
-		if (fabsf(angle) < playerFOV / 2 && distance > 0.1)
+		texW = sprite->sprite->texels.w;
+		texH = sprite->sprite->texels.h;
+		SDL_SetTextureColorMod(texture, light, light, light);
+		for (int x = sprite->firstVisible; x <= sprite->lastVisible + 1; x++)
 		{
-			/* Project the enemy’s position onto the screen */
-			float screenX = (SCREEN_W / 2) + (SCREEN_W / 2) *
-				(enemyRel.x * player->dir.x + enemyRel.y * player->dir.y) / distance;
-			float screenY = (SCREEN_H / 2) - (SCREEN_H / 2) *
-				(enemyRel.x * player->dir.y - enemyRel.y * player->dir.x) / distance;
+			bool visible = x <= sprite->lastVisible &&
+				sprite->depth < state->columnHits[x].distance;
 
-			float scale = 64 / distance;
+			if (visible && runStart < 0)
+				runStart = x;
+			if (visible || runStart < 0)
+				continue;
 
+			SDL_Rect srcRect = {
+				.x = (runStart - sprite->startX) * texW / sprite->size,
+				.y = 0,
+				.w = MAX((x - runStart) * texW / sprite->size, 1),
+				.h = texH
+			};
 			SDL_Rect dstRect = {
-				.x = (int)(screenX - (scale * 32)),
-				.y = (int)(screenY - (scale * 32)),
-				.w = (int)(scale * 64),
-				.h = (int)(scale * 64)
+				.x = runStart,
+				.y = state->viewH / 2 - sprite->size / 2,
+				.w = x - runStart,
+				.h = sprite->size
 			};
 
-			/* Render the enemy texture */
-			SDL_RenderCopy(state->renderer, enemy->texture, NULL, &dstRect);
+			SDL_RenderCopy(state->renderer, texture, &srcRect, &dstRect);
+			profile_draw(state, texture);
+			runStart = -1;
+		}
+	}
+}
+
+/**
+ * draw_enemies_software - Draws the enemies into the software framebuffer.
+ * @state: Pointer to the State holding the enemies and this frame's hits.
+ * @player: Pointer to the Player structure containing player information.
+ * @pixels: The locked framebuffer memory.
+ * @pitch: The length of a framebuffer row in bytes.
+ * Description: Same projection and depth test as render_enemies(); texels
+ * with an alpha below one half are treated as transparent. Sprites are read
+ * from the column-major mip level matching their on-screen size.
+ */
+void draw_enemies_software(State *state, Player *player, uint32_t *pixels,
+	int pitch)
+{
+	int count = project_enemies(state, player);
+	for (int i = 0; i < count; i++)
+	{
+		SpriteProjection *sprite = &state->sprites[i];
+		const Texels *texels = select_mip(&sprite->sprite->columns,
+			sprite->size);
+		int top = state->viewH / 2 - sprite->size / 2;
+		int drawStart = MAX(top, 0);
+		int drawEnd = MIN(state->viewH / 2 + sprite->size / 2, state->viewH);
+		const uint8_t *shade = state->colormap[light_level(LIGHT_FULL,
+			sprite->depth)];
+
+		for (int x = sprite->firstVisible; x <= sprite->lastVisible; x++)
+		{
+			if (sprite->depth >= state->columnHits[x].distance)
+				continue;
+			int texX = (x - sprite->startX) * texels->w / sprite->size;
+			const uint32_t *column = &texels->pixels[texX * texels->h];
+			uint8_t *dst = (uint8_t *)pixels + drawStart * pitch +
+				x * sizeof(uint32_t);
+
+			for (int y = drawStart; y < drawEnd; y++, dst += pitch)
+			{
+				int texY = (y - top) * texels->h / sprite->size;
+				uint32_t color = column[texY];
+
+				if (color >> 24 >= 0x80)
+					*(uint32_t *)dst = shade_texel(shade, color);
+			}
 		}
 	}
 }
@@ -0,0 +1,123 @@
+#include "structure.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+/**
+ * dda_avx2_supported - Checks whether the AVX2 packet DDA can run here.
+ * Return: true if the kernel was compiled in and the CPU supports AVX2.
+ */
+bool dda_avx2_supported(void)
+{
+#ifdef HAVE_AVX2_KERNEL
+	return (SDL_HasAVX2());
+#else
+	return (false);
+#endif
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/**
+ * perform_dda_avx2 - Runs perform_dda() on 8 rays at once.
+ * @mapBox: The map cells of the 8 rays, updated to the cells hit.
+ * @sideDist: The distances to the next grid lines, updated like perform_dda.
+ * @deltaDist: The distances between grid lines of each ray.
+ * @stepDir: The step directions of each ray.
+ * @side: Where the side hit by each ray is stored.
+ * @map: the map which is used during the game.
+ * Description: Every lane takes exactly the steps the scalar loop would
+ * take, with the same float additions, so the results match perform_dda()
+ * bit for bit. Lanes that hit a wall are masked off and stop stepping
+ * while the rest of the packet keeps going. Cells are tested per lane
+ * through map_solid(), so no lane can read outside the map.
+ */
+__attribute__((target("avx2")))
+void perform_dda_avx2(Vec2I mapBox[8], Vec2F sideDist[8],
+	const Vec2F deltaDist[8], const Vec2I stepDir[8], Side side[8],
+	const Map *map)
+{
+	__m256 sdx, sdy, ddx, ddy;
+	__m256i mx, my, stx, sty, sd, active;
+	const __m256i eastWest = _mm256_set1_epi32(EastWest);
+	int32_t boxX[8], boxY[8], tiles[8];
+
+#define LANES(arr, f) arr[0].f, arr[1].f, arr[2].f, arr[3].f, \
+	arr[4].f, arr[5].f, arr[6].f, arr[7].f
+	sdx = _mm256_setr_ps(LANES(sideDist, x));
+	sdy = _mm256_setr_ps(LANES(sideDist, y));
+	ddx = _mm256_setr_ps(LANES(deltaDist, x));
+	ddy = _mm256_setr_ps(LANES(deltaDist, y));
+	mx = _mm256_setr_epi32(LANES(mapBox, x));
+	my = _mm256_setr_epi32(LANES(mapBox, y));
+	stx = _mm256_setr_epi32(LANES(stepDir, x));
+	sty = _mm256_setr_epi32(LANES(stepDir, y));
+#undef LANES
+	sd = _mm256_setzero_si256();
+	active = _mm256_set1_epi32(-1);
+
+	do {
+		__m256i xs = _mm256_castps_si256(_mm256_cmp_ps(sdx, sdy, _CMP_LT_OQ));
+		__m256i stepX = _mm256_and_si256(xs, active);
+		__m256i stepY = _mm256_andnot_si256(xs, active);
+
+		sdx = _mm256_blendv_ps(sdx, _mm256_add_ps(sdx, ddx),
+			_mm256_castsi256_ps(stepX));
+		sdy = _mm256_blendv_ps(sdy, _mm256_add_ps(sdy, ddy),
+			_mm256_castsi256_ps(stepY));
+		mx = _mm256_add_epi32(mx, _mm256_and_si256(stx, stepX));
+		my = _mm256_add_epi32(my, _mm256_and_si256(sty, stepY));
+		/* Active lanes record the axis they stepped on, like *side = ... */
+		sd = _mm256_blendv_epi8(sd, _mm256_and_si256(xs, eastWest), active);
+
+		_mm256_storeu_si256((__m256i *)boxX, mx);
+		_mm256_storeu_si256((__m256i *)boxY, my);
+		for (int i = 0; i < 8; i++)
+			tiles[i] = map_solid(map, boxX[i], boxY[i]);
+		__m256i hit = _mm256_cmpgt_epi32(
+			_mm256_loadu_si256((const __m256i *)tiles), _mm256_setzero_si256());
+
+		active = _mm256_andnot_si256(hit, active);
+	} while (!_mm256_testz_si256(active, active));
+
+	float outX[8], outY[8];
+	int32_t sides[8];
+
+	_mm256_storeu_ps(outX, sdx);
+	_mm256_storeu_ps(outY, sdy);
+	_mm256_storeu_si256((__m256i *)boxX, mx);
+	_mm256_storeu_si256((__m256i *)boxY, my);
+	_mm256_storeu_si256((__m256i *)sides, sd);
+	for (int i = 0; i < 8; i++)
+	{
+		sideDist[i] = (Vec2F) {outX[i], outY[i]};
+		mapBox[i] = (Vec2I) {boxX[i], boxY[i]};
+		side[i] = (Side)sides[i];
+	}
+}
+#else
+/**
+ * perform_dda_avx2 - Placeholder on targets without the AVX2 kernel.
+ * @mapBox: Unused.
+ * @sideDist: Unused.
+ * @deltaDist: Unused.
+ * @stepDir: Unused.
+ * @side: Unused.
+ * @map: Unused.
+ * Description: dda_avx2_supported() returns false on these targets, so this
+ * is never called.
+ */
+void perform_dda_avx2(Vec2I mapBox[8], Vec2F sideDist[8],
+	const Vec2F deltaDist[8], const Vec2I stepDir[8], Side side[8],
+	const Map *map)
+{
+	(void)mapBox;
+	(void)sideDist;
+	(void)deltaDist;
+	(void)stepDir;
+	(void)side;
+	(void)map;
+	ASSERT(false, "AVX2 DDA kernel is not available on this target\n");
+}
+#endif
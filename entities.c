@@ -0,0 +1,360 @@
+#include "structure.h"
+
+/* The spatial hash never has fewer buckets than this */
+#define MIN_BUCKETS 256
+
+/**
+ * init_entity_pool - Prepares an empty entity pool.
+ * @pool: The pool to initialize.
+ * Description: Types have no sprite and no speed until the caller sets
+ * pool->sprites and pool->speeds.
+ */
+void init_entity_pool(EntityPool *pool)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->rng = 0x9E3779B9;
+}
+
+/**
+ * free_entity_pool - Releases the arrays and sprites of an entity pool.
+ * @pool: The pool to free.
+ * @registry: The registry the sprites were acquired from.
+ */
+void free_entity_pool(EntityPool *pool, AssetRegistry *registry)
+{
+	for (int t = 0; t < NumEntityTypes; t++)
+		release_asset(registry, pool->sprites[t]);
+	free(pool->posX);
+	free(pool->posY);
+	free(pool->velX);
+	free(pool->velY);
+	free(pool->type);
+	free(pool->bucketStart);
+	free(pool->sorted);
+	free(pool->bucketOf);
+	init_entity_pool(pool);
+}
+
+/**
+ * random_unit - Draws the next number of the pool's generator.
+ * @pool: The pool.
+ * Return: A number in [0, 1); the sequence only depends on the spawns made.
+ */
+static float random_unit(EntityPool *pool)
+{
+	pool->rng ^= pool->rng << 13;
+	pool->rng ^= pool->rng >> 17;
+	pool->rng ^= pool->rng << 5;
+	return ((pool->rng >> 8) * (1.0f / 16777216.0f));
+}
+
+/**
+ * cell_bucket - Hashes a map cell to a bucket of the spatial hash.
+ * @pool: The pool.
+ * @x: The x-coordinate of the cell.
+ * @y: The y-coordinate of the cell.
+ * Return: The bucket.
+ */
+static inline uint32_t cell_bucket(const EntityPool *pool, int x, int y)
+{
+	return (((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u) &
+		(uint32_t)(pool->numBuckets - 1));
+}
+
+/**
+ * grow_entity_pool - Doubles the room of an entity pool.
+ * @pool: The pool, full.
+ * Description: The spatial hash keeps at least one bucket per entity of
+ * room, so buckets stay short however many entities there are. The
+ * program exits if memory runs out.
+ */
+static void grow_entity_pool(EntityPool *pool)
+{
+	int capacity = pool->capacity ? pool->capacity * 2 : 64;
+	int buckets = MIN_BUCKETS;
+
+	while (buckets < capacity)
+		buckets *= 2;
+	pool->posX = realloc(pool->posX, sizeof(float) * capacity);
+	pool->posY = realloc(pool->posY, sizeof(float) * capacity);
+	pool->velX = realloc(pool->velX, sizeof(float) * capacity);
+	pool->velY = realloc(pool->velY, sizeof(float) * capacity);
+	pool->type = realloc(pool->type, capacity);
+	pool->sorted = realloc(pool->sorted, sizeof(int) * capacity);
+	pool->bucketOf = realloc(pool->bucketOf, sizeof(uint32_t) * capacity);
+	pool->bucketStart = realloc(pool->bucketStart,
+		sizeof(int) * (buckets + 1));
+	ASSERT(pool->posX && pool->posY && pool->velX && pool->velY &&
+		pool->type && pool->sorted && pool->bucketOf && pool->bucketStart,
+		"Out of memory for %d entities\n", capacity);
+	pool->capacity = capacity;
+	pool->numBuckets = buckets;
+	pool->hashValid = false;
+}
+
+/**
+ * spawn_entity - Adds an entity heading in a random direction.
+ * @pool: The pool.
+ * @type: The type of the entity.
+ * @pos: Where the entity starts.
+ * Return: The index of the new entity.
+ */
+int spawn_entity(EntityPool *pool, EntityType type, Vec2F pos)
+{
+	int i = pool->count;
+	float angle = random_unit(pool) * 2 * PI;
+
+	if (i == pool->capacity)
+		grow_entity_pool(pool);
+	pool->posX[i] = pos.x;
+	pool->posY[i] = pos.y;
+	pool->velX[i] = cosf(angle) * pool->speeds[type];
+	pool->velY[i] = sinf(angle) * pool->speeds[type];
+	pool->type[i] = type;
+	pool->count++;
+	pool->hashValid = false;
+	return (i);
+}
+
+/**
+ * scatter_entities - Spawns entities in random empty cells of a map.
+ * @pool: The pool.
+ * @map: The map.
+ * @type: The type of the entities.
+ * @count: How many entities to spawn.
+ * Description: Each entity tries a few random cells and is dropped if none
+ * of them is empty, so a map with no room cannot hang the game.
+ */
+void scatter_entities(EntityPool *pool, const Map *map, EntityType type,
+	int count)
+{
+	for (int n = 0; n < count; n++)
+	{
+		for (int attempt = 0; attempt < 64; attempt++)
+		{
+			int x = (int)(random_unit(pool) * map->width);
+			int y = (int)(random_unit(pool) * map->height);
+
+			if (map_solid(map, x, y))
+				continue;
+			spawn_entity(pool, type, (Vec2F) {x + 0.5f, y + 0.5f});
+			break;
+		}
+	}
+}
+
+/**
+ * hash_entities - Rebuilds the spatial hash from the current positions.
+ * @pool: The pool.
+ * Description: A counting sort by bucket: one pass counts the entities of
+ * each bucket, a prefix sum turns the counts into starts and a second pass
+ * places each entity. Entities of a bucket end up next to each other in
+ * pool->sorted, so a cell is scanned without chasing pointers.
+ */
+static void hash_entities(EntityPool *pool)
+{
+	int *start = pool->bucketStart;
+
+	if (!pool->capacity)
+		return;
+	memset(start, 0, sizeof(int) * (pool->numBuckets + 1));
+	for (int i = 0; i < pool->count; i++)
+	{
+		pool->bucketOf[i] = cell_bucket(pool, (int)pool->posX[i],
+			(int)pool->posY[i]);
+		start[pool->bucketOf[i] + 1]++;
+	}
+	for (int b = 0; b < pool->numBuckets; b++)
+		start[b + 1] += start[b];
+	/* Placing bumps each start to the end of its bucket... */
+	for (int i = 0; i < pool->count; i++)
+		pool->sorted[start[pool->bucketOf[i]]++] = i;
+	/* ...which is the start of the next one */
+	memmove(start + 1, start, sizeof(int) * pool->numBuckets);
+	start[0] = 0;
+	pool->hashValid = true;
+}
+
+/**
+ * separate_entity - Works out how far an entity is pushed by its neighbours.
+ * @pool: The pool, with a valid spatial hash.
+ * @i: The entity.
+ * Return: The displacement that removes half of every overlap with the
+ * entities it touches; the neighbour removes the other half. Only the
+ * cells within two radii are scanned, at most 2x2 of them.
+ */
+static Vec2F separate_entity(const EntityPool *pool, int i)
+{
+	float x = pool->posX[i], y = pool->posY[i];
+	int x0 = (int)(x - 2 * ENTITY_RADIUS), x1 = (int)(x + 2 * ENTITY_RADIUS);
+	int y0 = (int)(y - 2 * ENTITY_RADIUS), y1 = (int)(y + 2 * ENTITY_RADIUS);
+	Vec2F push = {0.0f, 0.0f};
+
+	for (int cy = y0; cy <= y1; cy++)
+		for (int cx = x0; cx <= x1; cx++)
+		{
+			uint32_t b = cell_bucket(pool, cx, cy);
+
+			for (int k = pool->bucketStart[b]; k < pool->bucketStart[b + 1]; k++)
+			{
+				int j = pool->sorted[k];
+				float ox = x - pool->posX[j], oy = y - pool->posY[j];
+				float d2 = ox * ox + oy * oy, d;
+
+				/* Skip entities of other cells that share the bucket */
+				if (j == i || (int)pool->posX[j] != cx ||
+					(int)pool->posY[j] != cy || d2 == 0.0f ||
+					d2 >= 4 * ENTITY_RADIUS * ENTITY_RADIUS)
+					continue;
+				d = sqrtf(d2);
+				push.x += ox * (ENTITY_RADIUS - d / 2) / d;
+				push.y += oy * (ENTITY_RADIUS - d / 2) / d;
+			}
+		}
+	return (push);
+}
+
+/**
+ * blocked - Checks whether a point is inside a wall.
+ * @map: The map.
+ * @x: The x-coordinate of the point.
+ * @y: The y-coordinate of the point.
+ * Return: true if the cell under the point is solid.
+ */
+static inline bool blocked(const Map *map, float x, float y)
+{
+	return (map_solid(map, (int)floorf(x), (int)floorf(y)));
+}
+
+/**
+ * steer_entity - Points an entity along the flow field.
+ * @pool: The pool.
+ * @flow: The flow field.
+ * @i: The entity.
+ * Description: The entity heads for the center of the next cell on its
+ * path, which takes it around wall corners. Entities outside the field,
+ * or that cannot reach its source, keep their velocity.
+ */
+static void steer_entity(EntityPool *pool, const FlowField *flow, int i)
+{
+	Vec2F target;
+	float dx, dy, length;
+
+	if (!flow_target(flow, (Vec2I) {(int)pool->posX[i], (int)pool->posY[i]},
+		&target))
+		return;
+	dx = target.x - pool->posX[i];
+	dy = target.y - pool->posY[i];
+	length = sqrtf(dx * dx + dy * dy);
+	if (length < 0.01f)
+	{
+		pool->velX[i] = 0.0f;
+		pool->velY[i] = 0.0f;
+		return;
+	}
+	pool->velX[i] = dx / length * pool->speeds[pool->type[i]];
+	pool->velY[i] = dy / length * pool->speeds[pool->type[i]];
+}
+
+/**
+ * update_entities - Moves every entity by one time step.
+ * @pool: The pool.
+ * @map: The map the entities collide with.
+ * @flow: The flow field the entities follow, or NULL to let them wander.
+ * @dt: The length of the step in seconds.
+ * Description: Each entity is steered by the flow field, so the cost per
+ * entity is one lookup however many there are. It then moves along its
+ * velocity, pushed apart from the neighbours it overlaps, and collides
+ * with the walls one axis at a time like the player does; an axis that
+ * runs into a wall is cancelled and its velocity reflected. The spatial
+ * hash is rebuilt afterwards so queries see the new positions.
+ */
+void update_entities(EntityPool *pool, const Map *map,
+	const FlowField *flow, float dt)
+{
+	if (!pool->count)
+		return;
+	if (!pool->hashValid)
+		hash_entities(pool);
+	/* In bucket order, so neighbours read are mostly already in cache */
+	for (int k = 0; k < pool->count; k++)
+	{
+		int i = pool->sorted[k];
+		float x = pool->posX[i], y = pool->posY[i], nx, ny;
+		Vec2F push;
+
+		if (flow)
+			steer_entity(pool, flow, i);
+		push = separate_entity(pool, i);
+		nx = x + pool->velX[i] * dt + push.x;
+		ny = y + pool->velY[i] * dt + push.y;
+		if (blocked(map, nx + copysignf(ENTITY_RADIUS, nx - x), y))
+		{
+			if ((nx - x) * pool->velX[i] > 0)
+				pool->velX[i] = -pool->velX[i];
+			nx = x;
+		}
+		if (blocked(map, nx, ny + copysignf(ENTITY_RADIUS, ny - y)))
+		{
+			if ((ny - y) * pool->velY[i] > 0)
+				pool->velY[i] = -pool->velY[i];
+			ny = y;
+		}
+		pool->posX[i] = nx;
+		pool->posY[i] = ny;
+	}
+	hash_entities(pool);
+}
+
+/**
+ * query_entities - Finds the entities within a radius of a point.
+ * @pool: The pool.
+ * @center: The point.
+ * @radius: The radius, in cells.
+ * @out: Where the indices of the entities found are stored.
+ * @max: The number of entries @out has room for.
+ * Return: The number of entities found, at most @max, in no useful order.
+ * Description: Only the buckets of the cells the circle overlaps are
+ * scanned. When those cells outnumber the entities, or positions changed
+ * since the hash was built, every entity is tested instead.
+ */
+int query_entities(const EntityPool *pool, Vec2F center, float radius,
+	int *out, int max)
+{
+	int x0 = (int)floorf(center.x - radius), x1 = (int)floorf(center.x + radius);
+	int y0 = (int)floorf(center.y - radius), y1 = (int)floorf(center.y + radius);
+	float r2 = radius * radius;
+	int found = 0;
+
+	if (!pool->hashValid ||
+		(long)(x1 - x0 + 1) * (y1 - y0 + 1) >= pool->count)
+	{
+		for (int i = 0; i < pool->count && found < max; i++)
+		{
+			float dx = pool->posX[i] - center.x, dy = pool->posY[i] - center.y;
+
+			if (dx * dx + dy * dy <= r2)
+				out[found++] = i;
+		}
+		return (found);
+	}
+	for (int cy = y0; cy <= y1; cy++)
+		for (int cx = x0; cx <= x1; cx++)
+		{
+			uint32_t b = cell_bucket(pool, cx, cy);
+
+			for (int k = pool->bucketStart[b]; k < pool->bucketStart[b + 1]; k++)
+			{
+				int i = pool->sorted[k];
+				float dx = pool->posX[i] - center.x, dy = pool->posY[i] - center.y;
+
+				if ((int)pool->posX[i] != cx || (int)pool->posY[i] != cy ||
+					dx * dx + dy * dy > r2)
+					continue;
+				if (found == max)
+					return (found);
+				out[found++] = i;
+			}
+		}
+	return (found);
+}
@@ -0,0 +1,211 @@
+#include "structure.h"
+
+/* Neighbour offsets; orthogonal ones first so BFS prefers straight moves */
+static const Vec2I flowDirs[8] = {
+	{1, 0}, {0, 1}, {-1, 0}, {0, -1}, {1, 1}, {-1, 1}, {-1, -1}, {1, -1}
+};
+
+/**
+ * init_flow_field - Allocates an empty flow field.
+ * @flow: The flow field to initialize.
+ * Description: The program exits if memory runs out.
+ */
+void init_flow_field(FlowField *flow)
+{
+	memset(flow, 0, sizeof(*flow));
+	flow->direction = malloc(FLOW_SIZE * FLOW_SIZE);
+	flow->building = malloc(FLOW_SIZE * FLOW_SIZE);
+	flow->queue = malloc(sizeof(int) * FLOW_SIZE * FLOW_SIZE);
+	ASSERT(flow->direction && flow->building && flow->queue,
+		"Out of memory for the flow field\n");
+}
+
+/**
+ * free_flow_field - Releases the buffers of a flow field.
+ * @flow: The flow field to free.
+ */
+void free_flow_field(FlowField *flow)
+{
+	free(flow->direction);
+	free(flow->building);
+	free(flow->queue);
+	memset(flow, 0, sizeof(*flow));
+}
+
+/**
+ * start_flow_build - Starts building the field toward a new source.
+ * @flow: The flow field.
+ * @map: The map, whose revision the build is tagged with.
+ * @source: The cell everything flows to.
+ */
+static void start_flow_build(FlowField *flow, const Map *map, Vec2I source)
+{
+	int center = FLOW_RADIUS * FLOW_SIZE + FLOW_RADIUS;
+
+	memset(flow->building, FLOW_NONE, FLOW_SIZE * FLOW_SIZE);
+	flow->buildSource = source;
+	flow->buildOrigin = (Vec2I) {source.x - FLOW_RADIUS,
+		source.y - FLOW_RADIUS};
+	flow->buildRevision = map->revision;
+	flow->building[center] = FLOW_SOURCE;
+	flow->queue[0] = center;
+	flow->head = 0;
+	flow->tail = 1;
+	flow->busy = true;
+}
+
+/**
+ * walkable - Checks whether a cell of the window can be walked on.
+ * @flow: The flow field being built.
+ * @map: The map.
+ * @x: The x-coordinate of the cell in the window.
+ * @y: The y-coordinate of the cell in the window.
+ * Return: true if the cell is inside the window and empty.
+ */
+static inline bool walkable(const FlowField *flow, const Map *map, int x,
+	int y)
+{
+	return ((unsigned int)x < FLOW_SIZE && (unsigned int)y < FLOW_SIZE &&
+		!map_solid(map, flow->buildOrigin.x + x, flow->buildOrigin.y + y));
+}
+
+/**
+ * expand_flow - Runs the breadth-first search for a bounded number of cells.
+ * @flow: The flow field, with a build in progress.
+ * @map: The map.
+ * @budget: The number of cells to take off the queue at most.
+ * Description: Each newly reached cell records the direction back to the
+ * cell it was reached from, the first step of a shortest path to the
+ * source. Diagonal steps are allowed when both cells beside them are
+ * empty, so paths never cut a wall corner.
+ */
+static void expand_flow(FlowField *flow, const Map *map, int budget)
+{
+	while (flow->head < flow->tail && budget-- > 0)
+	{
+		int cell = flow->queue[flow->head++];
+		int x = cell % FLOW_SIZE, y = cell / FLOW_SIZE;
+
+		for (int d = 0; d < 8; d++)
+		{
+			int nx = x + flowDirs[d].x, ny = y + flowDirs[d].y;
+			int next = ny * FLOW_SIZE + nx;
+
+			if (!walkable(flow, map, nx, ny) ||
+				flow->building[next] != FLOW_NONE)
+				continue;
+			if (d >= 4 && (!walkable(flow, map, nx, y) ||
+				!walkable(flow, map, x, ny)))
+				continue;
+			/* The opposite direction of d, from the new cell back to cell */
+			flow->building[next] = d < 4 ? (d + 2) % 4 : 4 + (d - 4 + 2) % 4;
+			flow->queue[flow->tail++] = next;
+		}
+	}
+}
+
+/**
+ * follow_source - Patches the field to flow to a neighbour of its source.
+ * @flow: The flow field.
+ * @map: The map.
+ * @next: The cell the player moved to.
+ * Return: true if the field now flows to @next, false if @next is not a
+ * neighbour it can be patched to.
+ * Description: The old source steps to @next, which becomes the source,
+ * so every path reaches the player one cell longer at most. Following the
+ * entries only ever leads to cells that were the source later, so the
+ * patched field has no loops.
+ */
+static bool follow_source(FlowField *flow, const Map *map, Vec2I next)
+{
+	Vec2I step = {next.x - flow->source.x, next.y - flow->source.y};
+	int x = flow->source.x - flow->origin.x;
+	int y = flow->source.y - flow->origin.y;
+	int d = 0;
+
+	if (abs(step.x) > 1 || abs(step.y) > 1 ||
+		(unsigned int)(x + step.x) >= FLOW_SIZE ||
+		(unsigned int)(y + step.y) >= FLOW_SIZE ||
+		map_solid(map, next.x, next.y))
+		return (false);
+	/* The same corners expand_flow() refuses to cut */
+	if (step.x && step.y && (map_solid(map, next.x, flow->source.y) ||
+		map_solid(map, flow->source.x, next.y)))
+		return (false);
+	while (flowDirs[d].x != step.x || flowDirs[d].y != step.y)
+		d++;
+	flow->direction[y * FLOW_SIZE + x] = d;
+	flow->direction[(y + step.y) * FLOW_SIZE + x + step.x] = FLOW_SOURCE;
+	flow->source = next;
+	flow->patches++;
+	return (true);
+}
+
+/**
+ * update_flow_field - Keeps the flow field pointing at the player.
+ * @flow: The flow field.
+ * @map: The map.
+ * @source: The cell of the player.
+ * Description: Called once per simulation step. When the player steps to
+ * a neighbouring cell the field is patched by follow_source() rather than
+ * thrown away. A new field is built in a back buffer, FLOW_STEP_BUDGET
+ * cells per step, after FLOW_PATCH_LIMIT patches, when the map changes or
+ * when the player moved in a way that cannot be patched; enemies keep
+ * following the current field meanwhile, and the buffers are swapped once
+ * the search is complete. A build is only restarted if the map changes
+ * before it finishes; if the player moved on meanwhile, the new field is
+ * patched or rebuilt on the next call.
+ */
+void update_flow_field(FlowField *flow, const Map *map, Vec2I source)
+{
+	bool fresh = flow->valid && flow->mapRevision == map->revision;
+	uint8_t *done;
+
+	if (fresh && (flow->source.x != source.x || flow->source.y != source.y))
+		fresh = follow_source(flow, map, source);
+	if (fresh && flow->patches < FLOW_PATCH_LIMIT && !flow->busy)
+		return;
+	if (!flow->busy || flow->buildRevision != map->revision)
+		start_flow_build(flow, map, source);
+	expand_flow(flow, map, FLOW_STEP_BUDGET);
+	if (flow->head < flow->tail)
+		return;
+	done = flow->building;
+	flow->building = flow->direction;
+	flow->direction = done;
+	flow->origin = flow->buildOrigin;
+	flow->source = flow->buildSource;
+	flow->mapRevision = flow->buildRevision;
+	flow->patches = 0;
+	flow->valid = true;
+	flow->busy = false;
+}
+
+/**
+ * flow_target - Looks up where an entity in a cell should head next.
+ * @flow: The flow field.
+ * @cell: The map cell the entity is in.
+ * @target: Where the center of the next cell on the way is stored, or the
+ * center of @cell if it is the source.
+ * Return: false if the cell is outside the field or cannot reach the
+ * source, true otherwise.
+ */
+bool flow_target(const FlowField *flow, Vec2I cell, Vec2F *target)
+{
+	int x = cell.x - flow->origin.x, y = cell.y - flow->origin.y;
+	uint8_t d;
+
+	if (!flow->valid || (unsigned int)x >= FLOW_SIZE ||
+		(unsigned int)y >= FLOW_SIZE)
+		return (false);
+	d = flow->direction[y * FLOW_SIZE + x];
+	if (d == FLOW_NONE)
+		return (false);
+	if (d != FLOW_SOURCE)
+	{
+		cell.x += flowDirs[d].x;
+		cell.y += flowDirs[d].y;
+	}
+	*target = (Vec2F) {cell.x + 0.5f, cell.y + 0.5f};
+	return (true);
+}
@@ -0,0 +1,137 @@
+#include "structure.h"
+
+/**
+ * sample_column - Copies a run of texels from one texture column to screen.
+ * @dst: The framebuffer pixel of the first row to draw.
+ * @pitch: The length of a framebuffer row in bytes.
+ * @count: The number of rows to draw.
+ * @column: The column-major texels of the texture column.
+ * @h: The height of the column in texels.
+ * @texPos: The 16.16 fixed-point texel row of the first pixel.
+ * @step: The 16.16 fixed-point number of texels per pixel.
+ * @shade: The colormap row of the column's light level.
+ * @pow2: Whether @h is a power of two; callers pass a constant so each
+ * case gets its own loop, wrapping with a mask instead of a clamp.
+ */
+static inline void sample_column(uint8_t *dst, int pitch, int count,
+	const uint32_t *column, int h, uint32_t texPos, uint32_t step,
+	const uint8_t *shade, bool pow2)
+{
+	for (int i = 0; i < count; i++, dst += pitch, texPos += step)
+	{
+		int texY = texPos >> 16;
+
+		texY = pow2 ? texY & (h - 1) : MIN(texY, h - 1);
+		*(uint32_t *)dst = shade_texel(shade, column[texY]);
+	}
+}
+
+/**
+ * draw_column_software - Samples one wall texture column into the framebuffer
+ * @pixels: The locked framebuffer memory.
+ * @pitch: The length of a framebuffer row in bytes.
+ * @height: The number of rows of the view.
+ * @x: The view column to draw.
+ * @lineHeight: The projected height of the wall slice.
+ * @shade: The colormap row of the light level, see wall_light().
+ * @mips: The mip chain of the texture of the wall that was hit.
+ * @wallX: Where on the wall the ray hit, in the range [0, 1).
+ * Description: The level is picked from @lineHeight, so a distant wall
+ * reads a short, contiguous column instead of striding through the
+ * full-size texture.
+ */
+void draw_column_software(uint32_t *pixels, int pitch, int height, int x,
+	int lineHeight, const uint8_t *shade, const ColumnMips *mips, float wallX)
+{
+	int drawStart, drawEnd, texX;
+	uint32_t step, texPos;
+	const Texels *level;
+	uint8_t *dst;
+
+	drawStart = -lineHeight / 2 + height / 2;
+	if (drawStart < 0)
+		drawStart = 0;
+	drawEnd = lineHeight / 2 + height / 2;
+	if (drawEnd >= height)
+		drawEnd = height;
+	if (drawStart >= drawEnd)
+		return;
+
+	level = select_mip(mips, lineHeight);
+	texX = (int)(wallX * level->w);
+	if (texX >= level->w)
+		texX = level->w - 1;
+	step = (uint32_t)(((uint64_t)level->h << 16) / lineHeight);
+	texPos = (uint32_t)(drawStart - height / 2 + lineHeight / 2) * step;
+	dst = (uint8_t *)pixels + drawStart * pitch + x * sizeof(uint32_t);
+
+	if (mips->pow2)
+		sample_column(dst, pitch, drawEnd - drawStart,
+			&level->pixels[texX * level->h], level->h, texPos, step,
+			shade, true);
+	else
+		sample_column(dst, pitch, drawEnd - drawStart,
+			&level->pixels[texX * level->h], level->h, texPos, step,
+			shade, false);
+}
+
+/**
+ * render_software - Renders the scene through a CPU-side framebuffer.
+ * @state: Pointer to the State structure holding the streaming texture.
+ * @player: Pointer to the Player structure containing player information.
+ * @map: the map which is used during the game.
+ * Return: None
+ * Description: The floor, ceiling and walls are cast and their texels
+ * written straight into the locked streaming texture, so the whole 3D
+ * view costs one texture upload and one SDL_RenderCopy instead of one
+ * copy per screen column. Only the state->viewW x state->viewH corner of
+ * the texture is drawn and uploaded.
+ */
+void render_software(State *state, Player *player,
+	const Map *map)
+{
+	SDL_Rect view = {0, 0, state->viewW, state->viewH};
+	void *pixels;
+	int pitch;
+	Uint64 start = profile_begin(state);
+
+	cast_columns(state, player, map);
+	profile_end(state, StageRaycast, start);
+	if (SDL_LockTexture(state->frameTexture, &view, &pixels, &pitch) != 0)
+	{
+		fprintf(stderr, "Failed to lock framebuffer: %s\n", SDL_GetError());
+		return;
+	}
+	start = profile_begin(state);
+	render_floor_ceiling(state, player, map, pixels, pitch);
+	profile_end(state, StageFloor, start);
+	start = profile_begin(state);
+	for (int x = 0; x < state->viewW; ++x)
+	{
+		const ColumnHit *hit = &state->columnHits[x];
+
+		draw_column_software(pixels, pitch, state->viewH, x,
+			(int)(state->viewH / hit->distance),
+			state->colormap[wall_light(hit)],
+			&state->wallTiles[map_tile(map, hit->mapBox.x,
+				hit->mapBox.y)]->columns, hit->wallX);
+	}
+	profile_end(state, StageWalls, start);
+	start = profile_begin(state);
+	draw_enemies_software(state, player, pixels, pitch);
+	SDL_UnlockTexture(state->frameTexture);
+	SDL_RenderCopy(state->renderer, state->frameTexture, &view, &view);
+	profile_draw(state, state->frameTexture);
+	profile_end(state, StageSprites, start);
+	if (state->mapViewEnabled)
+	{
+		start = profile_begin(state);
+		update_minimap(state, map, player->pos);
+		SDL_RenderSetScale(state->renderer, (float)state->viewW / SCREEN_W,
+			(float)state->viewH / SCREEN_H);
+		draw_map(state, map);
+		draw_player(state, player);
+		SDL_RenderSetScale(state->renderer, 1.0f, 1.0f);
+		profile_end(state, StageMap, start);
+	}
+}
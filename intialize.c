@@ -1,32 +1,33 @@
 #include "structure.h"
 
-/**
- * xy2index - Converts (x, y) coordinates to a single index for a 2D map.
- * @x: The x-coordinate in the map.
- * @y: The y-coordinate in the map.
- * @w: The width of the map.
- * Return: The computed index for the given (x, y) coordinates.
- * Description: This function calculates the index in a 1D array representation
- * of a 2D map based on the provided (x, y) coordinates
- * and the width of the map
- */
-int xy2index(int x, int y, int w)
-{
-	return (y * w + x);
-}
-
 /**
  * initialize_sdl - Initializes the SDL library
  * and creates a window and renderer
  * @state: A pointer to the State structure to be initialized.
- * Description: This function initializes the SDL video subsystem, creates an
- * SDL window with high DPI support, and sets up an SDL renderer with vertical
- * synchronization enabled. It also sets the SDL relative mouse mode. If any
- * of these operations fail, it prints an error message
- * and terminates the program
+ * Description: This function initializes the SDL video subsystem (on the
+ * offscreen or dummy driver when state->headless is set), creates an SDL
+ * window with high DPI support, and sets up an SDL renderer, with vertical
+ * synchronization unless state->vsync is off. It also sets the SDL relative
+ * mouse mode, starts the ray casting thread pool with state->numThreads
+ * threads (one per CPU by default), creates the streaming framebuffer
+ * texture CPU-drawn pixels are uploaded to and the render target the 3D
+ * view is cached in, both big enough for the largest view scale, and the
+ * render target the map view's cells are pre-rendered into, and queues the
+ * textures on the asset registry, filling the tile-to-texture tables; they
+ * are decoded in the background and show a placeholder until then. If any
+ * of these operations fail, it prints an error message and terminates the
+ * program
  */
 void initialize_sdl(State *state)
 {
+	if (state->headless)
+	{
+		/* Rendered through SDL's offscreen driver, no display needed */
+		SDL_SetHint(SDL_HINT_VIDEODRIVER, "offscreen");
+		if (SDL_Init(SDL_INIT_VIDEO) != 0)
+			SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+		SDL_Quit();
+	}
 	ASSERT(!SDL_Init(SDL_INIT_VIDEO),
 		"SDL failed to initialize; %s\n", SDL_GetError());
 	state->window = SDL_CreateWindow("Raycast",
@@ -37,21 +38,65 @@ void initialize_sdl(State *state)
 									  SDL_WINDOW_ALLOW_HIGHDPI);
 	ASSERT(state->window, "failed to create SDL window: %s\n", SDL_GetError());
 	state->renderer = SDL_CreateRenderer(state->window, -1,
-		SDL_RENDERER_PRESENTVSYNC);
+		state->vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
 	ASSERT(state->renderer, "failed to create SDL renderer: %s\n",
 		SDL_GetError());
 	SDL_SetHint(SDL_HINT_MOUSE_RELATIVE_MODE_WARP, "1");
 	SDL_SetRelativeMouseMode(true);
-	state->floorTextures[1]	= load_texture(state->renderer,
+	init_asset_registry(&state->assets, state->renderer);
+	/* Every wall tile value shares the stone texture until a level says so */
+	for (int i = 1; i < 256; ++i)
+		state->wallTiles[i] = acquire_asset(&state->assets,
+			"./texture/stone_wall_texture.jpg");
+	/* Empty cells are tile 0: grass underfoot, stone overhead */
+	state->floorTiles[0] = acquire_asset(&state->assets,
 		"./texture/wild_grass.jpg");
-	state->wallTextures[1] = load_texture(state->renderer,
+	state->ceilingTiles[0] = acquire_asset(&state->assets,
 		"./texture/stone_wall_texture.jpg");
-	state->wallTextures[2] = load_texture(state->renderer,
-		"./texture/stone_wall_texture.jpg");
-	state->wallTextures[3] = load_texture(state->renderer,
-		"./texture/stone_wall_texture.jpg");
-	state->weaponTexture[1] = load_texture(state->renderer,
-		"./texture/weapon_1.png");
+	state->weapon = acquire_asset(&state->assets, "./texture/weapon_1.png");
+	state->enemySprite = acquire_asset(&state->assets,
+		"./texture/enemy_1.png");
+	build_colormap(state->colormap);
+	init_entity_pool(&state->enemies);
+	state->enemies.sprites[EntityEnemy] = retain_asset(state->enemySprite);
+	state->enemies.speeds[EntityEnemy] = ENEMY_SPEED;
+	init_flow_field(&state->flow);
+	if (state->numThreads <= 0)
+		state->numThreads = SDL_GetCPUCount();
+	state->pool = create_thread_pool(state->numThreads);
+	state->profiler = create_profiler();
+	if (state->simdDda && !dda_avx2_supported())
+		state->simdDda = false;
+	state->frameTexture = SDL_CreateTexture(state->renderer,
+		SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+		VIEW_MAX_W, VIEW_MAX_H);
+	ASSERT(state->frameTexture, "failed to create framebuffer: %s\n",
+		SDL_GetError());
+	state->wallSpans = malloc(VIEW_MAX_W * sizeof(WallSpan));
+	state->wallVertices = malloc(VIEW_MAX_W * 4 * sizeof(SDL_Vertex));
+	state->wallIndices = malloc(VIEW_MAX_W * 6 * sizeof(int));
+	ASSERT(state->wallSpans && state->wallVertices && state->wallIndices,
+		"Out of memory for the wall batches\n");
+	/* Without render targets every frame is simply drawn from scratch */
+	state->sceneTexture = SDL_CreateTexture(state->renderer,
+		SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+		VIEW_MAX_W, VIEW_MAX_H);
+#if SDL_VERSION_ATLEAST(2, 0, 12)
+	/* Filter the view when it is stretched to the window */
+	if (state->sceneTexture)
+		SDL_SetTextureScaleMode(state->sceneTexture, SDL_ScaleModeLinear);
+#endif
+	/* The map view falls back to drawing every cell without one */
+	if (state->sceneTexture)
+		state->minimap.texture = SDL_CreateTexture(state->renderer,
+			SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+			MINIMAP_CACHE_TILES * MINIMAP_TILE,
+			MINIMAP_CACHE_TILES * MINIMAP_TILE);
+	state->minimap.walls = malloc(sizeof(SDL_Rect) * MINIMAP_CACHE_TILES *
+		((MINIMAP_CACHE_TILES + 1) / 2));
+	ASSERT(state->minimap.walls, "Out of memory for the map view\n");
+	set_view_scale(state, state->scaler.scale ? state->scaler.scale :
+		VIEW_SCALE_UNIT);
 }
 
 /**
@@ -109,17 +154,19 @@ void initialize_raycasting(Player *player, Vec2F rayDir,
  * @state: A pointer to the State structure containing the renderer.
  * @player: A pointer to the Player structure with player details.
  * Description: This function draws the player as a small rectangle and
- * their line of sight as a line on the 2D map.
+ * their line of sight as a line on the 2D map, offset by the cells the
+ * map view is cropped by.
  */
 void draw_player(State *state, Player *player)
 {
-	int tileSize = 10; /* Size of each tile in pixels */
 	int playerSize = 3; /* Size of the player on the map */
+	Vec2F pos = {player->pos.x - state->minimap.view.x,
+		player->pos.y - state->minimap.view.y};
 
 	/* Draw player */
 	SDL_Rect playerRect = {
-		.x = (int)(player->pos.x * tileSize) - (playerSize / 2),
-		.y = (int)(player->pos.y * tileSize) - (playerSize / 2),
+		.x = (int)(pos.x * MINIMAP_TILE) - (playerSize / 2),
+		.y = (int)(pos.y * MINIMAP_TILE) - (playerSize / 2),
 		.w = playerSize,
 		.h = playerSize
 	};
@@ -127,48 +174,66 @@ void draw_player(State *state, Player *player)
 	SDL_SetRenderDrawColor(state->renderer, RGBA_Red.r,
 		RGBA_Red.g, RGBA_Red.b, RGBA_Red.a);
 	SDL_RenderFillRect(state->renderer, &playerRect);
+	profile_draw(state, NULL);
 
 	/* Draw line of sight*/
 	Vec2F sightEnd = {
-		.x = player->pos.x + player->dir.x * 5.0f,
+		.x = pos.x + player->dir.x * 5.0f,
 		/* Adjust length of line of sight if needed */
-		.y = player->pos.y + player->dir.y * 5.0f
+		.y = pos.y + player->dir.y * 5.0f
 	};
 
 	SDL_SetRenderDrawColor(state->renderer, RGBA_Blue.r,
 		RGBA_Blue.g, RGBA_Blue.b, RGBA_Blue.a);
 	SDL_RenderDrawLine(state->renderer,
-		(int)(player->pos.x * tileSize),
-		(int)(player->pos.y * tileSize),
-		(int)(sightEnd.x * tileSize),
-		(int)(sightEnd.y * tileSize)
+		(int)(pos.x * MINIMAP_TILE),
+		(int)(pos.y * MINIMAP_TILE),
+		(int)(sightEnd.x * MINIMAP_TILE),
+		(int)(sightEnd.y * MINIMAP_TILE)
 	);
+	profile_draw(state, NULL);
 }
 
 /**
  * draw_map - Draws the 2D map on the window.
  * @state: A pointer to the State structure containing the renderer.
- * @MAP: The map data to be rendered.
- * Description: This function iterates through the MAP array and draws
- * walls and ground on the window using different colors.
+ * @map: The map data to be rendered.
+ * Description: Shows the cells update_minimap() picked in the top-left
+ * corner. They are copied from the pre-rendered minimap texture in one
+ * call; without render targets every cell is filled one at a time, walls
+ * and ground in different colors.
  */
-void draw_map(State *state, uint8_t MAP[MAP_SIZE * MAP_SIZE])
+void draw_map(State *state, const Map *map)
 {
-	int tileSize = 10, y; /* Size of each tile in pixels */
+	const Minimap *minimap = &state->minimap;
+	SDL_Rect shown = {0, 0, minimap->viewSize.x * MINIMAP_TILE,
+		minimap->viewSize.y * MINIMAP_TILE};
 
-	for (y = 0; y < MAP_SIZE; y++)
+	if (minimap->texture && minimap->valid)
+	{
+		SDL_Rect cached = {(minimap->view.x - minimap->origin.x) *
+			MINIMAP_TILE, (minimap->view.y - minimap->origin.y) *
+			MINIMAP_TILE, shown.w, shown.h};
+
+		SDL_RenderCopy(state->renderer, minimap->texture, &cached,
+			&shown);
+		profile_draw(state, minimap->texture);
+		return;
+	}
+	for (int y = 0; y < minimap->viewSize.y; y++)
 	{
-		for (int x = 0; x < MAP_SIZE; x++)
+		for (int x = 0; x < minimap->viewSize.x; x++)
 		{
 			SDL_Rect tile = {
-				.x = x * tileSize,
-				.y = y * tileSize,
-				.w = tileSize,
-				.h = tileSize
+				.x = x * MINIMAP_TILE,
+				.y = y * MINIMAP_TILE,
+				.w = MINIMAP_TILE,
+				.h = MINIMAP_TILE
 			};
-			int map = xy2index(x, y, MAP_SIZE);
+			uint8_t value = map_tile(map, minimap->view.x + x,
+				minimap->view.y + y);
 
-			if (MAP[map] == 1 || MAP[map] == 2 || MAP[map] == 3) /* Wall */
+			if (value == 1 || value == 2 || value == 3) /* Wall */
 			{
 				SDL_SetRenderDrawColor(state->renderer,
 					RGBA_wall.r, RGBA_wall.g, RGBA_wall.b, RGBA_wall.a);
@@ -179,6 +244,7 @@ void draw_map(State *state, uint8_t MAP[MAP_SIZE * MAP_SIZE])
 					RGBA_Ground.g, RGBA_Ground.b, RGBA_Ground.a);
 			}
 			SDL_RenderFillRect(state->renderer, &tile);
+			profile_draw(state, NULL);
 		}
 	}
 }
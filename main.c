@@ -16,32 +16,55 @@ Player initialize_player(void)
 }
 
 /**
- * handle_input - Handles user input and updates the Player and
- * State based on keyboard and mouse events.
+ * poll_events - Drains the SDL event queue once per rendered frame.
  * @state: A pointer to the State structure to be updated.
- * @player: A pointer to the Player structure to be updated.
- * @rotateSpeed: The speed at which the player
- * should rotate based on mouse movement.
- * Description: This function processes events
- * from the SDL event queue, including
- * keyboard inputs for quitting the application
- * and mouse movements for rotating the
- * player's view. It updates the direction
- * and plane vectors of the Player structure
- * based on the mouse's relative movement.
+ * Description: Handles quitting, toggles the map view on each press of M
+ * and, from the next frame on, the profiler on each press of P, and notes
+ * when the window or the cached scene has to be redrawn. Pumping the queue
+ * also refreshes the keyboard state that the simulation steps read.
  */
-void handle_input(State *state, Player *player, float rotateSpeed)
+void poll_events(State *state)
 {
 	SDL_Event event;
-	Vec2F oldPlane, oldDir;
-	float rotSpeed = 0.0f;
-	const uint8_t *keystate = SDL_GetKeyboardState(NULL);
 
 	while (SDL_PollEvent(&event))
 	{
 		if (event.type == SDL_QUIT)
 			state->quit = true;
+		else if (event.type == SDL_WINDOWEVENT)
+			state->presentNeeded = true;
+		else if (event.type == SDL_RENDER_TARGETS_RESET ||
+			event.type == SDL_RENDER_DEVICE_RESET)
+		{
+			state->sceneValid = false;
+			state->minimap.valid = false;
+		}
+		else if (event.type == SDL_KEYDOWN && !event.key.repeat &&
+			event.key.keysym.scancode == SDL_SCANCODE_M)
+			state->mapViewEnabled = !state->mapViewEnabled;
+		else if (event.type == SDL_KEYDOWN && !event.key.repeat &&
+			event.key.keysym.scancode == SDL_SCANCODE_P)
+			state->toggleProfiling = !state->toggleProfiling;
 	}
+}
+
+/**
+ * handle_input - Handles user input and updates the Player and
+ * State based on the keyboard state.
+ * @state: A pointer to the State structure to be updated.
+ * @player: A pointer to the Player structure to be updated.
+ * @keystate: The keyboard state of the current step.
+ * @rotateSpeed: The angle in radians the player rotates by in one step.
+ * Description: This function runs once per simulation step. It quits on
+ * escape and rotates the direction and plane vectors of the Player
+ * structure while the left or right arrow key is held.
+ */
+void handle_input(State *state, Player *player, const uint8_t *keystate,
+	float rotateSpeed)
+{
+	Vec2F oldPlane, oldDir;
+	float rotSpeed = 0.0f;
+
 	if (keystate[SDL_SCANCODE_ESCAPE])
 		state->quit = true;
 
@@ -63,12 +86,6 @@ void handle_input(State *state, Player *player, float rotateSpeed)
 		player->plane.y = oldPlane.x *
 			sinf(rotSpeed) + player->plane.y * cosf(rotSpeed);
 	}
-	if (keystate[SDL_SCANCODE_M])
-	{
-		state->mapViewEnabled = !state->mapViewEnabled;
-		/* Add a small delay to prevent rapid toggling */
-		SDL_Delay(200);
-	}
 }
 
 /**
@@ -76,63 +93,128 @@ void handle_input(State *state, Player *player, float rotateSpeed)
  * @player: A pointer to the Player structure to be updated.
  * @keystate: A pointer to the current state of the keyboard.
  * @moveSpeed: The speed at which the player should move.
- * @MAP: the map which is used during the game.
+ * @map: the map which is used during the game.
  */
 void update_player(Player *player, const uint8_t *keystate,
-	float moveSpeed, uint8_t MAP[MAP_SIZE * MAP_SIZE])
+	float moveSpeed, const Map *map)
 {
 	Vec2F deltaPos = {.x = player->dir.x *
 		moveSpeed, .y = player->dir.y * moveSpeed};
 
 	if (keystate[SDL_SCANCODE_W])
 	{
-		if (MAP[xy2index(player->pos.x + deltaPos.x, player->pos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x + deltaPos.x, player->pos.y))
 			player->pos.x += deltaPos.x;
-		if (MAP[xy2index(player->pos.x, player->pos.y + deltaPos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x, player->pos.y + deltaPos.y))
 			player->pos.y += deltaPos.y;
 	}
 	if (keystate[SDL_SCANCODE_S])
 	{
-		if (MAP[xy2index(player->pos.x - deltaPos.x, player->pos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x - deltaPos.x, player->pos.y))
 			player->pos.x -= deltaPos.x;
-		if (MAP[xy2index(player->pos.x, player->pos.y - deltaPos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x, player->pos.y - deltaPos.y))
 			player->pos.y -= deltaPos.y;
 	}
 	if (keystate[SDL_SCANCODE_A])
 	{
-		if (MAP[xy2index(player->pos.x - deltaPos.y, player->pos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x - deltaPos.y, player->pos.y))
 			player->pos.x -= deltaPos.y;
-		if (MAP[xy2index(player->pos.x, player->pos.y + deltaPos.x, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x, player->pos.y + deltaPos.x))
 			player->pos.y += deltaPos.x;
 	}
 	if (keystate[SDL_SCANCODE_D])
 	{
-		if (MAP[xy2index(player->pos.x + deltaPos.y, player->pos.y, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x + deltaPos.y, player->pos.y))
 			player->pos.x += deltaPos.y;
-		if (MAP[xy2index(player->pos.x, player->pos.y - deltaPos.x, MAP_SIZE)] == 0)
+		if (!map_solid(map, player->pos.x, player->pos.y - deltaPos.x))
 			player->pos.y -= deltaPos.x;
 	}
 }
 
 
+/**
+ * step_simulation - Advances the game by one fixed step of SIM_DT seconds.
+ * @state: A pointer to the State structure to be updated.
+ * @player: A pointer to the Player structure to be updated.
+ * @map: the map which is used during the game.
+ * Description: The keyboard state comes from replay_keys(), so a recorded
+ * run can be replayed step for step.
+ */
+void step_simulation(State *state, Player *player, const Map *map)
+{
+	const uint8_t *keystate = replay_keys(&state->replay);
+
+	Uint64 start = profile_begin(state);
+
+	handle_input(state, player, keystate, ROTATE_SPEED * SIM_DT);
+	profile_end(state, StageInput, start);
+	start = profile_begin(state);
+	update_player(player, keystate, MOVE_SPEED * SIM_DT, map);
+	profile_end(state, StageMovement, start);
+	start = profile_begin(state);
+	handle_enemies(state, map, player);
+	profile_end(state, StageEnemies, start);
+	state->simSteps++;
+}
+
+/**
+ * interpolate_player - Blends two simulated states of the player.
+ * @from: The player before the last simulation step.
+ * @to: The player after the last simulation step.
+ * @alpha: How far between the two steps the frame is, from 0 to 1.
+ * Return: The player to render the frame from. Direction and plane are
+ * blended linearly; a step turns them by so little that the result is
+ * indistinguishable from a true rotation.
+ */
+Player interpolate_player(const Player *from, const Player *to, float alpha)
+{
+	Player player = {
+		.pos = {from->pos.x + (to->pos.x - from->pos.x) * alpha,
+			from->pos.y + (to->pos.y - from->pos.y) * alpha},
+		.dir = {from->dir.x + (to->dir.x - from->dir.x) * alpha,
+			from->dir.y + (to->dir.y - from->dir.y) * alpha},
+		.plane = {from->plane.x + (to->plane.x - from->plane.x) * alpha,
+			from->plane.y + (to->plane.y - from->plane.y) * alpha},
+	};
+	return (player);
+}
+
 /**
  * cleanup - Cleans up SDL resources and quits SDL.
  * @state: A pointer to the State structure containing SDL resources.
- * Description: This function destroys the SDL renderer and window, and then
- * quits the SDL library. It should be called before the application exits to
- * release resources properly.
+ * Description: This function releases every asset handle and the asset
+ * registry, frees the enemies, stops the thread pool, frees the profiler,
+ * destroys the SDL renderer and window, and then quits the SDL library. It
+ * should be called before the application exits to release resources
+ * properly.
  */
 void cleanup(State *state)
 {
-	for (int i = 0; i < 4; ++i)
+	for (int i = 0; i < 256; ++i)
 	{
-		if (state->wallTextures[i])
-			SDL_DestroyTexture(state->wallTextures[i]);
-		if (state->floorTextures[i])
-			SDL_DestroyTexture(state->wallTextures[i]);
-		if (state->weaponTexture[i])
-			SDL_DestroyTexture(state->wallTextures[i]);
+		release_asset(&state->assets, state->wallTiles[i]);
+		release_asset(&state->assets, state->floorTiles[i]);
+		release_asset(&state->assets, state->ceilingTiles[i]);
 	}
+	free_entity_pool(&state->enemies, &state->assets);
+	free_flow_field(&state->flow);
+	release_asset(&state->assets, state->weapon);
+	release_asset(&state->assets, state->enemySprite);
+	destroy_asset_registry(&state->assets);
+	destroy_thread_pool(state->pool);
+	free(state->profiler);
+	free(state->wallSpans);
+	free(state->wallVertices);
+	free(state->wallIndices);
+	free(state->sprites);
+	free(state->nearby);
+	free(state->minimap.walls);
+	if (state->minimap.texture)
+		SDL_DestroyTexture(state->minimap.texture);
+	if (state->frameTexture)
+		SDL_DestroyTexture(state->frameTexture);
+	if (state->sceneTexture)
+		SDL_DestroyTexture(state->sceneTexture);
 	SDL_DestroyRenderer(state->renderer);
 	SDL_DestroyWindow(state->window);
 	SDL_Quit();
@@ -140,37 +222,150 @@ void cleanup(State *state)
 
 /**
  * main - The entry point of the application.
- * Return: 0 on successful completion.
+ * @argc: The number of command line arguments.
+ * @argv: The command line arguments, see parse_args().
+ * Return: 0 on successful completion, 1 if a recording could not be
+ * written or a replay did not end in the recorded state.
  * Description: This function initializes SDL library and creates the Player
- * and State structures. It runs the main loop where it handles input, updates
- * the player, clears and renders the screen, and presents the rendered image.
- * The loop continues until the quit flag in the State structure is set to true
- * After exiting the loop, it cleans up SDL resources and exits.
+ * and State structures. Every frame it handles events, runs as many fixed
+ * simulation steps as the elapsed time calls for, pages in the map around
+ * the player, and renders the player interpolated between the last two
+ * simulated states, so the game runs at the same speed whether frames are
+ * paced by vsync or not. Textures decoded in the background are uploaded
+ * one per frame, replacing their placeholders. The 3D view is stretched
+ * over the window from the resolution it was rendered at, and the time
+ * frames take to render drives that resolution; waiting for vsync is not
+ * counted. Stages are timed by the profiler while it is on, and its
+ * recording is exported on exit if asked for. When neither the scene nor
+ * the HUD changed, nothing is drawn or presented and the loop sleeps until
+ * input arrives or the next simulation step is due. The loop continues
+ * until the quit flag in the State structure is set to true. After exiting
+ * the loop, it cleans up SDL resources and exits.
+ * With --record the steps, keys and interpolation of every frame are
+ * written to a file; with --replay they are read back from one instead of
+ * the clock and the keyboard, frames are not throttled, and the loop ends
+ * with the recording. While recording or replaying, a paged map is read
+ * in before each frame goes on, so both runs see the same tiles.
  */
-int main(void)
+int main(int argc, char **argv)
 {
-	uint8_t MAP[MAP_SIZE * MAP_SIZE];
-	const uint8_t *keystate = SDL_GetKeyboardState(NULL);
-
-	if (!load_map("map_1", &MAP))
-		return (1);  /* Exit if map loading fails */
-	Player player = initialize_player();
-	const float rotateSpeed = 0.025, moveSpeed = 0.05;
+	Map map;
+	Player player = initialize_player(), previous, view;
 	State state = {.quit = false, .mapViewEnabled = false,
-		.numEnemies = 0, .enemySpawnTimer = SDL_GetTicks()};
+		.enemySpawnTimer = 0, .vsync = true,
+		.renderMode = RenderSDL, .simdDda = true, .mapPath = "map_1",
+		.scaler = {.budgetMs = FRAME_BUDGET_MS}};
+	Uint64 lastTime;
+	double lag = 0.0;
+	bool ok;
 
+	if (!parse_args(argc, argv, &state) || !start_replay(&state))
+		return (1);
+	if (state.pageBudget ? !open_paged_map(state.mapPath, &map,
+		state.pageBudget) : !load_map(state.mapPath, &map))
+		return (1);  /* Exit if map loading fails */
+	player.pos = map.playerSpawn;
+	previous = player;
 	initialize_sdl(&state);
+	choose_dda_kernel(&state, &player, &map);
+	/* Replays never show placeholders, so runs draw the same frames */
+	if (state.replay.mode == ReplayPlay)
+		wait_for_assets(&state.assets);
+	scatter_entities(&state.enemies, &map, EntityEnemy, state.initialEnemies);
+	lastTime = SDL_GetPerformanceCounter();
 	while (!state.quit)
 	{
-		handle_input(&state, &player, rotateSpeed);
-		update_player(&player, keystate, moveSpeed, MAP);
-		handle_enemies(&state);
-		SDL_SetRenderDrawColor(state.renderer, 0x18, 0x18, 0x18, 0xFF);
-		SDL_RenderClear(state.renderer);
-		render(&state, &player, MAP);
-		render_weapon(&state);
-		SDL_RenderPresent(state.renderer);
+		Uint64 now = SDL_GetPerformanceCounter(), start, renderStart, drawn;
+		float alpha, renderMs = -1.0f;
+		int steps = 0;
+		bool rendered;
+
+		lag += (double)(now - lastTime) / SDL_GetPerformanceFrequency();
+		lag = MIN(lag, (double)SIM_MAX_STEPS / SIM_HZ);
+		lastTime = now;
+		if (state.toggleProfiling)
+		{
+			/* Redrawn to show or hide the overlay */
+			state.profiling = !state.profiling;
+			state.toggleProfiling = false;
+			state.presentNeeded = true;
+		}
+		profile_begin_frame(&state);
+		start = profile_begin(&state);
+		poll_events(&state);
+		profile_end(&state, StageEvents, start);
+		if (state.replay.mode == ReplayPlay)
+		{
+			if (!read_replay_frame(&state.replay, &steps, &alpha,
+				&state.mapViewEnabled))
+				break;
+		}
+		else
+		{
+			for (; lag >= 1.0 / SIM_HZ; lag -= 1.0 / SIM_HZ)
+				steps++;
+			alpha = lag * SIM_HZ;
+		}
+		for (int i = 0; i < steps; i++)
+		{
+			previous = player;
+			step_simulation(&state, &player, &map);
+		}
+		if (state.replay.mode == ReplayRecord)
+			write_replay_frame(&state.replay, alpha, state.mapViewEnabled);
+		view = interpolate_player(&previous, &player, alpha);
+		start = profile_begin(&state);
+		update_map_paging(&map, player.pos, (Vec2F) {
+			player.pos.x - previous.pos.x, player.pos.y - previous.pos.y},
+			state.replay.mode != ReplayOff);
+		profile_end(&state, StagePaging, start);
+		start = profile_begin(&state);
+		poll_assets(&state.assets);
+		profile_end(&state, StageAssets, start);
+		renderStart = SDL_GetPerformanceCounter();
+		rendered = render_scene(&state, &view, &map);
+		if (rendered || state.profiling || state.presentNeeded)
+		{
+			if (state.sceneTexture)
+			{
+				SDL_Rect viewRect = {0, 0, state.viewW, state.viewH};
+
+				SDL_RenderCopy(state.renderer, state.sceneTexture, &viewRect,
+					NULL);
+				profile_draw(&state, state.sceneTexture);
+			}
+			start = profile_begin(&state);
+			render_weapon(&state);
+			profile_end(&state, StageWeapon, start);
+			draw_profiler_overlay(&state);
+			drawn = SDL_GetPerformanceCounter();
+			start = profile_begin(&state);
+			SDL_RenderPresent(state.renderer);
+			profile_end(&state, StagePresent, start);
+			state.presentNeeded = false;
+			/* Without vsync, presenting waits for the GPU to finish */
+			if (!state.vsync)
+				drawn = SDL_GetPerformanceCounter();
+			if (rendered)
+			{
+				renderMs = (float)(drawn - renderStart) * 1000.0f /
+					SDL_GetPerformanceFrequency();
+				update_view_scale(&state, renderMs);
+			}
+		}
+		else if (state.replay.mode != ReplayPlay)
+			SDL_WaitEventTimeout(NULL, 1000 / SIM_HZ);
+		if (state.replay.mode == ReplayPlay)
+			time_replay_frame(&state.replay, (float)(SDL_GetPerformanceCounter()
+				- now) * 1000.0f / SDL_GetPerformanceFrequency(), renderMs);
+		profile_end_frame(&state);
 	}
+	ok = finish_replay(&state.replay, hash_game_state(&state, &player));
+	if (state.profileCsv)
+		export_profile_csv(state.profiler, state.profileCsv);
+	if (state.profileTrace)
+		export_profile_trace(state.profiler, state.profileTrace);
 	cleanup(&state);
-	return (0);
+	free_map(&map);
+	return (ok ? 0 : 1);
 }
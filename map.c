@@ -0,0 +1,226 @@
+#include "structure.h"
+#include <sys/mman.h>
+
+/**
+ * init_map - Allocates an empty map of the given size.
+ * @map: The map to initialize.
+ * @width: Number of tiles along x.
+ * @height: Number of tiles along y.
+ * Return: true on success, false if the size is invalid or memory runs out.
+ * Description: Storage is rounded up to whole chunks; the padding is never
+ * read because map_tile() bounds checks against the real size. Every
+ * non-zero tile is solid and the player spawns at (4, 4) until the caller
+ * says otherwise. There are no enemy spawn points, so handle_enemies()
+ * spawns enemies in random empty cells.
+ */
+bool init_map(Map *map, int width, int height)
+{
+	map->tiles = NULL;
+	map->chunks = NULL;
+	map->pager = NULL;
+	map->enemySpawns = NULL;
+	map->numEnemySpawns = 0;
+	map->mapping = NULL;
+	map->mappingSize = 0;
+	map->distance = NULL;
+	map->revision = 0;
+	map->playerSpawn = (Vec2F) {4.0f, 4.0f};
+	for (int i = 0; i < 256; i++)
+		map->tileFlags[i] = i ? TILE_SOLID : 0;
+	if (width <= 0 || height <= 0 || width > 32768 || height > 32768)
+	{
+		printf("Invalid map size %dx%d\n", width, height);
+		return (false);
+	}
+	map->width = width;
+	map->height = height;
+	map->chunksX = (width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	map->tiles = calloc(map_tiles_size(map), 1);
+	if (!map->tiles || !init_chunk_table(map, map->tiles))
+	{
+		printf("Out of memory for a %dx%d map\n", width, height);
+		free(map->tiles);
+		map->tiles = NULL;
+		return (false);
+	}
+	return (true);
+}
+
+/**
+ * map_chunk_count - Gets the number of chunks a map is stored in.
+ * @map: The map, with its size set.
+ * Return: The number of chunks, padding chunks included.
+ */
+int map_chunk_count(const Map *map)
+{
+	return (map->chunksX * ((map->height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT));
+}
+
+/**
+ * map_tiles_size - Gets the size of the tile storage of a map.
+ * @map: The map, with its size set.
+ * Return: The number of bytes in map->tiles, padding chunks included.
+ */
+size_t map_tiles_size(const Map *map)
+{
+	return ((size_t)map_chunk_count(map) * MAP_CHUNK_SIZE * MAP_CHUNK_SIZE);
+}
+
+/**
+ * init_chunk_table - Allocates map->chunks.
+ * @map: The map, with its size set.
+ * @tiles: Contiguous storage of every chunk to point the table into, or
+ * NULL to start with no chunk resident.
+ * Return: true on success, false if memory runs out.
+ */
+bool init_chunk_table(Map *map, uint8_t *tiles)
+{
+	int count = map_chunk_count(map);
+
+	map->chunks = calloc(count, sizeof(uint8_t *));
+	if (!map->chunks)
+		return (false);
+	for (int i = 0; tiles && i < count; i++)
+		map->chunks[i] = tiles + (size_t)i * MAP_CHUNK_SIZE * MAP_CHUNK_SIZE;
+	return (true);
+}
+
+/**
+ * update_distance_field - Keeps map->distance valid after a tile changes.
+ * @map: The map, with map->distance built.
+ * @x: The x-coordinate of the changed cell.
+ * @y: The y-coordinate of the changed cell.
+ * @solid: Whether the cell is solid now.
+ * Description: A new wall lowers the distances around it, out to the
+ * largest distance that could change. A removed wall only makes the cell 1;
+ * every other distance stays a lower bound, which is all ray traversal
+ * relies on, so they are left alone.
+ */
+static void update_distance_field(Map *map, int x, int y, bool solid)
+{
+	if (!solid)
+	{
+		map->distance[(size_t)y * map->width + x] = 1;
+		return;
+	}
+	for (int cy = MAX(y - 254, 0); cy <= MIN(y + 254, map->height - 1); cy++)
+	{
+		uint8_t *row = map->distance + (size_t)cy * map->width;
+
+		for (int cx = MAX(x - 254, 0); cx <= MIN(x + 254, map->width - 1); cx++)
+			row[cx] = MIN(row[cx], MAX(abs(cx - x), abs(cy - y)));
+	}
+}
+
+/**
+ * set_map_tile - Writes the tile of a cell.
+ * @map: The map.
+ * @x: The x-coordinate of the cell, inside the map.
+ * @y: The y-coordinate of the cell, inside the map.
+ * @tile: The new tile; ignored if the chunk of the cell is not resident.
+ */
+void set_map_tile(Map *map, int x, int y, uint8_t tile)
+{
+	uint8_t *chunk = map->chunks[(y >> MAP_CHUNK_SHIFT) * map->chunksX +
+		(x >> MAP_CHUNK_SHIFT)];
+
+	if (!chunk)
+		return;
+	chunk[(y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT | (x & MAP_CHUNK_MASK)] =
+		tile;
+	map->revision++;
+	if (map->distance)
+		update_distance_field(map, x, y,
+			map->tileFlags[tile] & TILE_SOLID);
+}
+
+/**
+ * build_distance_field - Computes map->distance from the tiles.
+ * @map: A map held completely in memory, not mapped from a file.
+ * Return: true on success, false if memory runs out.
+ * Description: A forward and a backward pass over the grid, each taking the
+ * minimum over the four neighbours already visited plus one, give the exact
+ * Chebyshev distance; cells outside the map count as solid.
+ */
+bool build_distance_field(Map *map)
+{
+	int w = map->width, h = map->height;
+	uint8_t *dist = malloc((size_t)w * h);
+
+	free(map->distance);
+	map->distance = dist;
+	if (!dist)
+		return (false);
+	for (int y = 0; y < h; y++)
+	{
+		uint8_t *row = dist + (size_t)y * w;
+		uint8_t *up = row - (y > 0 ? w : 0);
+
+		for (int x = 0; x < w; x++)
+		{
+			int d = 0;
+
+			if (map_solid(map, x, y))
+			{
+				row[x] = 0;
+				continue;
+			}
+			if (x > 0 && y > 0 && x + 1 < w)
+			{
+				d = MIN(row[x - 1], up[x - 1]);
+				d = MIN(d, up[x]);
+				d = MIN(d, up[x + 1]);
+			}
+			row[x] = MIN(d + 1, 255);
+		}
+	}
+	for (int y = h - 1; y >= 0; y--)
+	{
+		uint8_t *row = dist + (size_t)y * w;
+		uint8_t *down = row + (y + 1 < h ? w : 0);
+
+		for (int x = w - 1; x >= 0; x--)
+		{
+			int d = 0;
+
+			if (x > 0 && y + 1 < h && x + 1 < w)
+			{
+				d = MIN(row[x + 1], down[x + 1]);
+				d = MIN(d, down[x]);
+				d = MIN(d, down[x - 1]);
+			}
+			row[x] = MIN(row[x], d + 1);
+		}
+	}
+	return (true);
+}
+
+/**
+ * free_map - Releases the tiles of a map.
+ * @map: The map to free.
+ */
+void free_map(Map *map)
+{
+	if (map->pager)
+	{
+		close_map_pager(map);
+		free(map->enemySpawns);
+	}
+	else if (map->mapping)
+		munmap(map->mapping, map->mappingSize);
+	else
+	{
+		free(map->tiles);
+		free(map->enemySpawns);
+		free(map->distance);
+	}
+	free(map->chunks);
+	map->chunks = NULL;
+	map->distance = NULL;
+	map->mapping = NULL;
+	map->tiles = NULL;
+	map->enemySpawns = NULL;
+	map->numEnemySpawns = 0;
+	map->width = 0;
+	map->height = 0;
+}
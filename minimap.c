@@ -0,0 +1,114 @@
+#include "structure.h"
+
+/**
+ * center_window - Places a window of cells around a cell, inside the map.
+ * @center: The cell to center the window on.
+ * @extent: The number of cells the window covers.
+ * @mapSize: The number of cells of the map along the same axis.
+ * Return: The first cell of the window.
+ */
+static int center_window(int center, int extent, int mapSize)
+{
+	int first = center - extent / 2, last = mapSize - extent;
+
+	first = MIN(first, last);
+	return (MAX(first, 0));
+}
+
+/**
+ * is_minimap_wall - Tells the cells drawn as walls in the map view.
+ * @tile: The tile of the cell.
+ * Return: true for tiles 1 to 3, which includes cells not paged in yet.
+ */
+static bool is_minimap_wall(uint8_t tile)
+{
+	return (tile == 1 || tile == 2 || tile == 3);
+}
+
+/**
+ * redraw_minimap - Draws the cells from minimap->origin into the texture.
+ * @state: The game state.
+ * @map: The map.
+ * Description: The texture is cleared to the ground color and each run of
+ * walls along a row becomes one rectangle, all drawn with a single call.
+ * The render target of the caller is restored, which also resets its scale
+ * and viewport, so this runs before they are set.
+ */
+static void redraw_minimap(State *state, const Map *map)
+{
+	Minimap *minimap = &state->minimap;
+	SDL_Texture *target = SDL_GetRenderTarget(state->renderer);
+	int count = 0;
+
+	for (int y = 0; y < minimap->size.y; y++)
+	{
+		int cellY = minimap->origin.y + y;
+
+		for (int x = 0; x < minimap->size.x; x++)
+		{
+			int start = x;
+
+			if (!is_minimap_wall(map_tile(map, minimap->origin.x + x,
+				cellY)))
+				continue;
+			while (x + 1 < minimap->size.x && is_minimap_wall(
+				map_tile(map, minimap->origin.x + x + 1, cellY)))
+				x++;
+			minimap->walls[count++] = (SDL_Rect) {start * MINIMAP_TILE,
+				y * MINIMAP_TILE, (x - start + 1) * MINIMAP_TILE,
+				MINIMAP_TILE};
+		}
+	}
+	SDL_SetRenderTarget(state->renderer, minimap->texture);
+	SDL_SetRenderDrawColor(state->renderer, RGBA_Ground.r, RGBA_Ground.g,
+		RGBA_Ground.b, RGBA_Ground.a);
+	SDL_RenderClear(state->renderer);
+	profile_draw(state, NULL);
+	SDL_SetRenderDrawColor(state->renderer, RGBA_wall.r, RGBA_wall.g,
+		RGBA_wall.b, RGBA_wall.a);
+	SDL_RenderFillRects(state->renderer, minimap->walls, count);
+	profile_draw(state, NULL);
+	SDL_SetRenderTarget(state->renderer, target);
+	minimap->valid = true;
+	minimap->map = map;
+	minimap->revision = map->revision;
+}
+
+/**
+ * update_minimap - Picks the cells the map view shows and redraws them if
+ * needed.
+ * @state: The game state.
+ * @map: The map.
+ * @pos: The player's position.
+ * Description: Called before draw_map(), each time the scene is rendered
+ * with the map view on. Maps up to MINIMAP_VIEW_TILES cells wide and high
+ * are shown whole; larger ones are cropped to that many cells around the
+ * player. The texture holds a MINIMAP_CACHE_TILES window around the crop
+ * and is only redrawn when the map's tiles change or the crop leaves it.
+ */
+void update_minimap(State *state, const Map *map, Vec2F pos)
+{
+	Minimap *minimap = &state->minimap;
+	Vec2I view, viewSize = {MIN(map->width, MINIMAP_VIEW_TILES),
+		MIN(map->height, MINIMAP_VIEW_TILES)};
+
+	view.x = center_window((int)pos.x, viewSize.x, map->width);
+	view.y = center_window((int)pos.y, viewSize.y, map->height);
+	minimap->view = view;
+	minimap->viewSize = viewSize;
+	if (!minimap->texture)
+		return;
+	if (minimap->valid && minimap->map == map &&
+		minimap->revision == map->revision &&
+		view.x >= minimap->origin.x && view.y >= minimap->origin.y &&
+		view.x + viewSize.x <= minimap->origin.x + minimap->size.x &&
+		view.y + viewSize.y <= minimap->origin.y + minimap->size.y)
+		return;
+	minimap->size.x = MIN(map->width, MINIMAP_CACHE_TILES);
+	minimap->size.y = MIN(map->height, MINIMAP_CACHE_TILES);
+	minimap->origin.x = center_window(view.x + viewSize.x / 2,
+		minimap->size.x, map->width);
+	minimap->origin.y = center_window(view.y + viewSize.y / 2,
+		minimap->size.y, map->height);
+	redraw_minimap(state, map);
+}
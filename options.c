@@ -0,0 +1,177 @@
+#include "structure.h"
+
+/**
+ * print_usage - Prints the command line usage of the game.
+ * @name: The name the program was started with.
+ */
+static void print_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [--map FILE] [--renderer sdl|software]\n"
+		"\t[--threads N] [--dda auto|scalar] [--page-budget MB]\n"
+		"\t[--vsync on|off] [--profile] [--profile-csv FILE]\n"
+		"\t[--profile-trace FILE] [--enemies N] [--frame-budget MS]\n"
+		"\t[--view-scale PCT] [--record FILE | --replay FILE]\n"
+		"\t[--replay-timings FILE] [--headless]\n", name);
+}
+
+/**
+ * parse_args - Applies the command line options to the game state.
+ * @argc: The number of command line arguments.
+ * @argv: The command line arguments.
+ * @state: A pointer to the State structure to configure.
+ * Return: true if every option was understood, false otherwise.
+ */
+bool parse_args(int argc, char **argv, State *state)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--map") == 0 && i + 1 < argc)
+			state->mapPath = argv[++i];
+		else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "sdl") == 0)
+				state->renderMode = RenderSDL;
+			else if (strcmp(argv[i], "software") == 0)
+				state->renderMode = RenderSoftware;
+			else
+			{
+				fprintf(stderr, "Unknown renderer: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+		{
+			char *end;
+			long threads = strtol(argv[++i], &end, 10);
+
+			if (*end != '\0' || threads < 1 || threads > 256)
+			{
+				fprintf(stderr, "Invalid thread count: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+			state->numThreads = (int)threads;
+		}
+		else if (strcmp(argv[i], "--dda") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "auto") == 0)
+				state->simdDda = true;
+			else if (strcmp(argv[i], "scalar") == 0)
+				state->simdDda = false;
+			else
+			{
+				fprintf(stderr, "Unknown DDA kernel: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+		}
+		else if (strcmp(argv[i], "--profile") == 0)
+			state->profiling = true;
+		else if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc)
+		{
+			state->profileCsv = argv[++i];
+			state->profiling = true;
+		}
+		else if (strcmp(argv[i], "--profile-trace") == 0 && i + 1 < argc)
+		{
+			state->profileTrace = argv[++i];
+			state->profiling = true;
+		}
+		else if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "on") == 0)
+				state->vsync = true;
+			else if (strcmp(argv[i], "off") == 0)
+				state->vsync = false;
+			else
+			{
+				fprintf(stderr, "Unknown vsync mode: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+		}
+		else if (strcmp(argv[i], "--page-budget") == 0 && i + 1 < argc)
+		{
+			char *end;
+			long megabytes = strtol(argv[++i], &end, 10);
+
+			if (*end != '\0' || megabytes < 1 || megabytes > 65536)
+			{
+				fprintf(stderr, "Invalid page budget: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+			state->pageBudget = (size_t)megabytes << 20;
+		}
+		else if (strcmp(argv[i], "--enemies") == 0 && i + 1 < argc)
+		{
+			char *end;
+			long count = strtol(argv[++i], &end, 10);
+
+			if (*end != '\0' || count < 0 || count > 1000000)
+			{
+				fprintf(stderr, "Invalid enemy count: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+			state->initialEnemies = (int)count;
+		}
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+		{
+			char *end;
+			float budget = strtof(argv[++i], &end);
+
+			if (*end != '\0' || !(budget >= 0.0f && budget <= 1000.0f))
+			{
+				fprintf(stderr, "Invalid frame budget: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+			state->scaler.budgetMs = budget;
+		}
+		else if (strcmp(argv[i], "--view-scale") == 0 && i + 1 < argc)
+		{
+			char *end;
+			long percent = strtol(argv[++i], &end, 10);
+
+			if (*end != '\0' || percent < 50 || percent > 200)
+			{
+				fprintf(stderr, "Invalid view scale: %s\n", argv[i]);
+				print_usage(argv[0]);
+				return (false);
+			}
+			/* Rounded to the nearest step the view renders at */
+			state->scaler.scale = (int)((percent * VIEW_SCALE_UNIT + 50) / 100);
+		}
+		else if ((strcmp(argv[i], "--record") == 0 ||
+			strcmp(argv[i], "--replay") == 0) && i + 1 < argc)
+		{
+			ReplayMode mode = strcmp(argv[i], "--record") == 0 ?
+				ReplayRecord : ReplayPlay;
+
+			if (state->replay.mode != ReplayOff && state->replay.mode != mode)
+			{
+				fprintf(stderr, "--record and --replay are exclusive\n");
+				print_usage(argv[0]);
+				return (false);
+			}
+			state->replay.mode = mode;
+			state->replay.path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--replay-timings") == 0 && i + 1 < argc)
+			state->replay.timingsPath = argv[++i];
+		else if (strcmp(argv[i], "--headless") == 0)
+			state->headless = true;
+		else
+		{
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			print_usage(argv[0]);
+			return (false);
+		}
+	}
+	return (true);
+}
@@ -0,0 +1,438 @@
+#include "structure.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Maps are paged in square regions of REGION_CHUNKS x REGION_CHUNKS chunks */
+#define REGION_CHUNKS 8
+#define REGION_TILES (REGION_CHUNKS * MAP_CHUNK_SIZE)
+#define CHUNK_BYTES (MAP_CHUNK_SIZE * MAP_CHUNK_SIZE)
+#define REGION_BYTES (REGION_CHUNKS * REGION_CHUNKS * CHUNK_BYTES)
+/* Regions within this many tiles of the player are always kept resident */
+#define PAGE_RADIUS 128.0f
+/* How far ahead along the direction of travel regions are prefetched */
+#define PAGE_LOOKAHEAD 256.0f
+
+/**
+ * enum RegionStatus - Where a region of a paged map is
+ * @RegionAbsent: Not in memory and not requested
+ * @RegionQueued: Waiting for or being read by the loader thread
+ * @RegionReady: Read, waiting for the main thread to install it
+ * @RegionResident: Installed in Map.chunks
+ */
+typedef enum RegionStatus
+{
+	RegionAbsent, RegionQueued, RegionReady, RegionResident
+} RegionStatus;
+
+/**
+ * struct MapPager - Keeps the regions around the player of a map resident
+ * @fd: The binary map file.
+ * @tilesOffset: Offset of the tile array in the file.
+ * @chunksY: Number of rows of chunks.
+ * @regionsX: Number of regions per row of regions.
+ * @regionsY: Number of rows of regions.
+ * @data: Tiles of each region, NULL unless ready or resident.
+ * @status: RegionStatus of each region.
+ * @lastNeeded: Frame each region was last needed or prefetched in.
+ * @frame: Number of calls to update_map_paging() so far.
+ * @committed: Regions queued, ready or resident, counted against @budget.
+ * @budget: Maximum number of regions to keep once nothing is needed.
+ * @queue: Ring buffer of regions for the loader thread.
+ * @queueHead: Index of the next region to load in @queue.
+ * @queueCount: Number of regions in @queue.
+ * @thread: The loader thread.
+ * @lock: Protects @data, @status, the queue and @quit.
+ * @wake: Signalled when a region is queued or on shutdown.
+ * @quit: Set when the pager is being closed.
+ */
+struct MapPager
+{
+	int fd;
+	uint64_t tilesOffset;
+	int chunksY;
+	int regionsX, regionsY;
+	uint8_t **data;
+	uint8_t *status;
+	Uint32 *lastNeeded;
+	Uint32 frame;
+	int committed;
+	int budget;
+	int *queue;
+	int queueHead, queueCount;
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	bool quit;
+};
+
+/**
+ * read_region - Reads the tiles of one region from the map file.
+ * @pager: The pager of the map.
+ * @map: The map.
+ * @region: The index of the region.
+ * Return: The tiles, chunk by chunk in region order; a region that cannot
+ * be read is returned solid so it blocks rays and movement.
+ */
+static uint8_t *read_region(MapPager *pager, const Map *map, int region)
+{
+	uint8_t *tiles = calloc(1, REGION_BYTES);
+	int cx0 = region % pager->regionsX * REGION_CHUNKS;
+	int cy0 = region / pager->regionsX * REGION_CHUNKS;
+	int width = MIN(REGION_CHUNKS, map->chunksX - cx0);
+
+	ASSERT(tiles, "Out of memory paging the map\n");
+	for (int ry = 0; ry < REGION_CHUNKS && cy0 + ry < pager->chunksY; ry++)
+	{
+		size_t size = (size_t)width * CHUNK_BYTES;
+		off_t offset = pager->tilesOffset +
+			((off_t)(cy0 + ry) * map->chunksX + cx0) * CHUNK_BYTES;
+
+		if (pread(pager->fd, tiles + ry * REGION_CHUNKS * CHUNK_BYTES,
+			size, offset) != (ssize_t)size)
+		{
+			fprintf(stderr, "Failed to read map region %d\n", region);
+			memset(tiles, MAP_SOLID, REGION_BYTES);
+			break;
+		}
+	}
+	return (tiles);
+}
+
+/**
+ * set_region_chunks - Points the chunks of a region into its tiles.
+ * @pager: The pager of the map.
+ * @map: The map.
+ * @region: The index of the region.
+ * @tiles: The tiles of the region, or NULL to make it non-resident.
+ */
+static void set_region_chunks(MapPager *pager, Map *map, int region,
+	uint8_t *tiles)
+{
+	int cx0 = region % pager->regionsX * REGION_CHUNKS;
+	int cy0 = region / pager->regionsX * REGION_CHUNKS;
+
+	map->revision++;
+	for (int ry = 0; ry < REGION_CHUNKS && cy0 + ry < pager->chunksY; ry++)
+		for (int rx = 0; rx < REGION_CHUNKS && cx0 + rx < map->chunksX; rx++)
+			map->chunks[(cy0 + ry) * map->chunksX + cx0 + rx] = tiles ?
+				tiles + (ry * REGION_CHUNKS + rx) * CHUNK_BYTES : NULL;
+}
+
+/**
+ * struct LoaderArgs - What the loader thread needs
+ * @pager: The pager to serve.
+ * @map: The paged map.
+ */
+typedef struct LoaderArgs
+{
+	MapPager *pager;
+	const Map *map;
+} LoaderArgs;
+
+/**
+ * loader_main - Reads queued regions in the background.
+ * @data: The LoaderArgs of the pager, freed by this thread.
+ * Return: Always 0.
+ * Description: The loader never touches Map.chunks; finished regions are
+ * marked ready and installed by the main thread between frames, so render
+ * threads never see a table that changes under them.
+ */
+static int loader_main(void *data)
+{
+	LoaderArgs args = *(LoaderArgs *)data;
+	MapPager *pager = args.pager;
+	int total = pager->regionsX * pager->regionsY;
+
+	free(data);
+	SDL_LockMutex(pager->lock);
+	while (true)
+	{
+		while (!pager->quit && pager->queueCount == 0)
+			SDL_CondWait(pager->wake, pager->lock);
+		if (pager->quit)
+			break;
+		int region = pager->queue[pager->queueHead];
+
+		pager->queueHead = (pager->queueHead + 1) % total;
+		pager->queueCount--;
+		SDL_UnlockMutex(pager->lock);
+		uint8_t *tiles = read_region(pager, args.map, region);
+
+		SDL_LockMutex(pager->lock);
+		pager->data[region] = tiles;
+		pager->status[region] = RegionReady;
+	}
+	SDL_UnlockMutex(pager->lock);
+	return (0);
+}
+
+/**
+ * request_region - Queues a region for the loader thread.
+ * @pager: The pager, locked by the caller.
+ * @region: The region; nothing happens unless it is absent.
+ */
+static void request_region(MapPager *pager, int region)
+{
+	int total = pager->regionsX * pager->regionsY;
+
+	if (pager->status[region] != RegionAbsent)
+		return;
+	pager->status[region] = RegionQueued;
+	pager->queue[(pager->queueHead + pager->queueCount) % total] = region;
+	pager->queueCount++;
+	pager->committed++;
+	SDL_CondSignal(pager->wake);
+}
+
+/**
+ * touch_square - Marks the regions around a point as needed this frame.
+ * @pager: The pager, locked by the caller.
+ * @center: The center of the square, in tiles.
+ * @request: Whether absent regions should be queued for loading.
+ * @map: The map, used when regions are loaded synchronously.
+ * @sync: Whether absent regions are read right away on this thread.
+ */
+static void touch_square(MapPager *pager, Vec2F center, bool request,
+	Map *map, bool sync)
+{
+	int x0 = MAX((int)floorf((center.x - PAGE_RADIUS) / REGION_TILES), 0);
+	int y0 = MAX((int)floorf((center.y - PAGE_RADIUS) / REGION_TILES), 0);
+	int x1 = MIN((int)floorf((center.x + PAGE_RADIUS) / REGION_TILES),
+		pager->regionsX - 1);
+	int y1 = MIN((int)floorf((center.y + PAGE_RADIUS) / REGION_TILES),
+		pager->regionsY - 1);
+
+	for (int ry = y0; ry <= y1; ry++)
+	{
+		for (int rx = x0; rx <= x1; rx++)
+		{
+			int region = ry * pager->regionsX + rx;
+
+			pager->lastNeeded[region] = pager->frame;
+			if (sync && pager->status[region] == RegionAbsent)
+			{
+				pager->data[region] = read_region(pager, map, region);
+				pager->status[region] = RegionReady;
+				pager->committed++;
+			}
+			else if (request)
+				request_region(pager, region);
+		}
+	}
+}
+
+/**
+ * evict_cold_regions - Frees the least recently needed regions over budget.
+ * @pager: The pager, locked by the caller.
+ * @map: The map whose chunk table is updated.
+ * Description: Regions needed or prefetched this frame are never evicted,
+ * so the budget can be exceeded for as long as they all stay in range.
+ */
+static void evict_cold_regions(MapPager *pager, Map *map)
+{
+	int total = pager->regionsX * pager->regionsY;
+
+	while (pager->committed > pager->budget)
+	{
+		int coldest = -1;
+
+		for (int i = 0; i < total; i++)
+			if (pager->status[i] == RegionResident &&
+				pager->lastNeeded[i] != pager->frame &&
+				(coldest < 0 || pager->lastNeeded[i] < pager->lastNeeded[coldest]))
+				coldest = i;
+		if (coldest < 0)
+			return;
+		set_region_chunks(pager, map, coldest, NULL);
+		free(pager->data[coldest]);
+		pager->data[coldest] = NULL;
+		pager->status[coldest] = RegionAbsent;
+		pager->committed--;
+	}
+}
+
+/**
+ * install_ready_regions - Makes regions read by the loader visible.
+ * @pager: The pager, locked by the caller.
+ * @map: The map whose chunk table is updated.
+ */
+static void install_ready_regions(MapPager *pager, Map *map)
+{
+	int total = pager->regionsX * pager->regionsY;
+
+	for (int i = 0; i < total; i++)
+	{
+		if (pager->status[i] != RegionReady)
+			continue;
+		set_region_chunks(pager, map, i, pager->data[i]);
+		pager->status[i] = RegionResident;
+	}
+}
+
+/**
+ * update_map_paging - Keeps the regions around the player resident.
+ * @map: The paged map.
+ * @pos: The position of the player.
+ * @velocity: How far the player moved since the last call.
+ * @sync: Whether regions are read on this thread before it returns.
+ * Description: Must be called from the main thread while no rays are being
+ * cast, once per frame. Regions read since the last call are installed,
+ * regions within PAGE_RADIUS of @pos are requested, regions around the
+ * point PAGE_LOOKAHEAD tiles ahead along @velocity are prefetched while
+ * the budget allows, and the least recently needed regions are evicted
+ * until the budget is met. Cells of regions that are still loading read as
+ * solid. With @sync nothing is left loading, so which cells are resident
+ * only depends on the positions passed in, as recordings need.
+ */
+void update_map_paging(Map *map, Vec2F pos, Vec2F velocity, bool sync)
+{
+	MapPager *pager = map->pager;
+	float speed = sqrtf(velocity.x * velocity.x + velocity.y * velocity.y);
+
+	if (!pager)
+		return;
+	SDL_LockMutex(pager->lock);
+	pager->frame++;
+	install_ready_regions(pager, map);
+	touch_square(pager, pos, true, map, sync);
+	if (speed > 0.0f)
+	{
+		Vec2F ahead = {pos.x + velocity.x / speed * PAGE_LOOKAHEAD,
+			pos.y + velocity.y / speed * PAGE_LOOKAHEAD};
+		bool prefetch = pager->committed < pager->budget;
+
+		touch_square(pager, ahead, prefetch, map, sync && prefetch);
+	}
+	if (sync)
+		install_ready_regions(pager, map);
+	evict_cold_regions(pager, map);
+	SDL_UnlockMutex(pager->lock);
+}
+
+/**
+ * create_pager - Allocates the pager of a map whose size is known.
+ * @map: The map.
+ * @fd: The open binary map file.
+ * @header: The validated header of the file.
+ * @budgetBytes: How much tile memory the pager should try to stay under.
+ * Return: The pager, with its loader thread running.
+ */
+static MapPager *create_pager(Map *map, int fd, const MapFileHeader *header,
+	size_t budgetBytes)
+{
+	MapPager *pager = calloc(1, sizeof(MapPager));
+	int total;
+	LoaderArgs *args = malloc(sizeof(LoaderArgs));
+
+	ASSERT(pager && args, "Out of memory paging the map\n");
+	pager->fd = fd;
+	pager->tilesOffset = header->tilesOffset;
+	pager->chunksY = (map->height + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	pager->regionsX = (map->chunksX + REGION_CHUNKS - 1) / REGION_CHUNKS;
+	pager->regionsY = (pager->chunksY + REGION_CHUNKS - 1) / REGION_CHUNKS;
+	total = pager->regionsX * pager->regionsY;
+	pager->data = calloc(total, sizeof(uint8_t *));
+	pager->status = calloc(total, sizeof(uint8_t));
+	pager->lastNeeded = calloc(total, sizeof(Uint32));
+	pager->queue = calloc(total, sizeof(int));
+	pager->budget = MAX((int)(budgetBytes / REGION_BYTES), 1);
+	pager->lock = SDL_CreateMutex();
+	pager->wake = SDL_CreateCond();
+	ASSERT(pager->data && pager->status && pager->lastNeeded &&
+		pager->queue && pager->lock && pager->wake,
+		"Out of memory paging the map\n");
+	*args = (LoaderArgs) {.pager = pager, .map = map};
+	pager->thread = SDL_CreateThread(loader_main, "map pager", args);
+	ASSERT(pager->thread, "failed to create map pager thread: %s\n",
+		SDL_GetError());
+	return (pager);
+}
+
+/**
+ * open_paged_map - Opens a binary map without loading its tiles.
+ * @filename: The name of the binary map file.
+ * @map: Where the map is stored; free it with free_map().
+ * @budgetBytes: How much tile memory to keep resident, at most, once the
+ * regions near the player are loaded.
+ * Return: true if the map was opened, false otherwise.
+ * Description: Only the regions around the player spawn are read before
+ * this returns; the rest is streamed in by update_map_paging().
+ */
+bool open_paged_map(const char *filename, Map *map, size_t budgetBytes)
+{
+	int fd = open(filename, O_RDONLY);
+	struct stat info;
+	MapFileHeader header;
+	size_t spawnsSize;
+
+	if (fd < 0)
+	{
+		printf("Failed to open map file: %s\n", filename);
+		return (false);
+	}
+	if (fstat(fd, &info) != 0 ||
+		pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+		!check_map_header(&header, info.st_size))
+	{
+		close(fd);
+		return (false);
+	}
+	memset(map, 0, sizeof(Map));
+	map->width = header.width;
+	map->height = header.height;
+	map->chunksX = (map->width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	memcpy(map->tileFlags, header.tileFlags, sizeof(map->tileFlags));
+	map->playerSpawn = header.playerSpawn;
+	map->numEnemySpawns = header.numEnemySpawns;
+	spawnsSize = header.numEnemySpawns * sizeof(Vec2F);
+	map->enemySpawns = malloc(MAX(spawnsSize, 1));
+	ASSERT(map->enemySpawns && init_chunk_table(map, NULL),
+		"Out of memory paging the map\n");
+	if (pread(fd, map->enemySpawns, spawnsSize, sizeof(header)) !=
+		(ssize_t)spawnsSize)
+		map->numEnemySpawns = 0;
+
+	map->pager = create_pager(map, fd, &header, budgetBytes);
+	SDL_LockMutex(map->pager->lock);
+	touch_square(map->pager, map->playerSpawn, false, map, true);
+	install_ready_regions(map->pager, map);
+	SDL_UnlockMutex(map->pager->lock);
+	if (!check_player_spawn(map))
+	{
+		free_map(map);
+		return (false);
+	}
+	return (true);
+}
+
+/**
+ * close_map_pager - Stops the loader thread and frees every region.
+ * @map: The paged map; its chunk table is left all NULL.
+ */
+void close_map_pager(Map *map)
+{
+	MapPager *pager = map->pager;
+	int total = pager->regionsX * pager->regionsY;
+
+	SDL_LockMutex(pager->lock);
+	pager->quit = true;
+	SDL_CondBroadcast(pager->wake);
+	SDL_UnlockMutex(pager->lock);
+	SDL_WaitThread(pager->thread, NULL);
+	for (int i = 0; i < total; i++)
+	{
+		if (pager->status[i] == RegionResident)
+			set_region_chunks(pager, map, i, NULL);
+		free(pager->data[i]);
+	}
+	close(pager->fd);
+	SDL_DestroyCond(pager->wake);
+	SDL_DestroyMutex(pager->lock);
+	free(pager->queue);
+	free(pager->lastNeeded);
+	free(pager->status);
+	free(pager->data);
+	free(pager);
+	map->pager = NULL;
+}
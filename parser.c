@@ -1,32 +1,369 @@
 #include "structure.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The tile array starts on a page boundary of the file */
+#define MAP_TILES_ALIGN 4096
 
 /**
- * load_map - Loads the map from a file and stores it in the MAP array.
- * @filename: The name of the file containing the map data.
- * @MAP: the map which is used during the game.
+ * count_row - Counts the tile values on one line of a text map.
+ * @line: The line.
+ * Return: The number of values on the line, -1 if something is not a number
+ */
+static int count_row(const char *line)
+{
+	int count = 0;
+	char *end;
+
+	while (true)
+	{
+		strtol(line, &end, 10);
+		if (end == line)
+			break;
+		count++;
+		line = end;
+	}
+	while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+		end++;
+	return (*end ? -1 : count);
+}
+
+/**
+ * measure_map - Finds the size of a text map.
+ * @file: The open map file, positioned at its start.
+ * @width: Where the number of values per row is stored.
+ * @height: Where the number of rows is stored.
+ * Return: true if every row has the same number of numeric values.
+ */
+static bool measure_map(FILE *file, int *width, int *height)
+{
+	char *line = NULL;
+	size_t size = 0;
+	bool ok = true;
+
+	*width = 0;
+	*height = 0;
+	while (ok && getline(&line, &size, file) != -1)
+	{
+		int count = count_row(line);
+
+		if (count == 0)
+			continue;
+		if (count < 0 || (*width && count != *width))
+		{
+			printf("Failed to read map data at row %d\n", *height);
+			ok = false;
+		}
+		*width = count;
+		(*height)++;
+	}
+	free(line);
+	return (ok);
+}
+
+/**
+ * fill_map - Reads the tiles of a text map into an initialized map.
+ * @file: The open map file, positioned at its start.
+ * @map: The map, already sized by measure_map().
+ */
+static void fill_map(FILE *file, Map *map)
+{
+	char *line = NULL, *cursor, *end;
+	size_t size = 0;
+	int y = 0;
+
+	while (y < map->height && getline(&line, &size, file) != -1)
+	{
+		if (count_row(line) == 0)
+			continue;
+		cursor = line;
+		for (int x = 0; x < map->width; x++, cursor = end)
+			set_map_tile(map, x, y, (uint8_t)strtol(cursor, &end, 10));
+		y++;
+	}
+	free(line);
+}
+
+/**
+ * check_map_header - Validates the header of a binary map file.
+ * @header: The header at the start of the mapping.
+ * @fileSize: The size of the whole file.
+ * Return: true if every offset and size in the header lies inside the file,
+ * the player spawns inside the map and MAP_SOLID is flagged solid.
+ */
+bool check_map_header(const MapFileHeader *header, size_t fileSize)
+{
+	Map sized = {.width = header->width, .height = header->height};
+	size_t spawnsEnd = sizeof(MapFileHeader) +
+		(size_t)header->numEnemySpawns * sizeof(Vec2F);
+	uint64_t cells = (uint64_t)header->width * header->height;
+
+	if (memcmp(header->magic, MAP_MAGIC, sizeof(header->magic)) != 0)
+	{
+		printf("Not a binary map file\n");
+		return (false);
+	}
+	if (header->version != MAP_VERSION ||
+		header->chunkShift != MAP_CHUNK_SHIFT)
+	{
+		printf("Unsupported map version %u (chunk shift %u)\n",
+			header->version, header->chunkShift);
+		return (false);
+	}
+	if (header->width == 0 || header->height == 0 ||
+		header->width > 32768 || header->height > 32768)
+	{
+		printf("Invalid map size %ux%u\n", header->width, header->height);
+		return (false);
+	}
+	sized.chunksX = (sized.width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	if (header->tilesSize != map_tiles_size(&sized) ||
+		header->tilesOffset < spawnsEnd ||
+		header->tilesOffset + header->tilesSize > fileSize ||
+		(header->distanceOffset != 0 &&
+		(header->distanceOffset < header->tilesOffset + header->tilesSize ||
+		header->distanceOffset > fileSize ||
+		cells > fileSize - header->distanceOffset)))
+	{
+		printf("Truncated or corrupt map file\n");
+		return (false);
+	}
+	if (!(header->tileFlags[MAP_SOLID] & TILE_SOLID))
+	{
+		printf("Tile %d must be solid, cells outside the map read as it\n",
+			MAP_SOLID);
+		return (false);
+	}
+	if (!(header->playerSpawn.x >= 0.0f &&
+		header->playerSpawn.x < header->width &&
+		header->playerSpawn.y >= 0.0f &&
+		header->playerSpawn.y < header->height))
+	{
+		printf("Player spawn (%g, %g) is outside the map\n",
+			header->playerSpawn.x, header->playerSpawn.y);
+		return (false);
+	}
+	return (true);
+}
+
+/**
+ * check_player_spawn - Checks that the player starts in an empty cell.
+ * @map: The map, with the cell of map->playerSpawn resident.
+ * Return: true if the spawn cell is inside the map and empty.
+ */
+bool check_player_spawn(const Map *map)
+{
+	Vec2F spawn = map->playerSpawn;
+
+	if (!(spawn.x >= 0.0f && spawn.y >= 0.0f && spawn.x < map->width &&
+		spawn.y < map->height))
+	{
+		printf("Player spawn (%g, %g) is outside the map\n", spawn.x,
+			spawn.y);
+		return (false);
+	}
+	if (!map_solid(map, (int)spawn.x, (int)spawn.y))
+		return (true);
+	printf("Player spawn (%g, %g) is inside a wall\n", spawn.x, spawn.y);
+	return (false);
+}
+
+/**
+ * load_binary_map - Maps a binary map file into memory.
+ * @filename: The name of the binary map file.
+ * @map: Where the map is stored; free it with free_map().
  * Return: true if the map is loaded successfully, false otherwise.
+ * Description: The tile array is stored in the same chunked layout as
+ * Map.tiles, so the map points straight into a private mapping of the file
+ * and pages are only read from disk when they are first touched. So does
+ * the distance field, when the file has one. Writes to the map stay in
+ * memory and never reach the file.
+ */
+bool load_binary_map(const char *filename, Map *map)
+{
+	int fd = open(filename, O_RDONLY);
+	struct stat info;
+	uint8_t *base;
+	const MapFileHeader *header;
+
+	if (fd < 0)
+	{
+		printf("Failed to open map file: %s\n", filename);
+		return (false);
+	}
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(MapFileHeader))
+	{
+		printf("Truncated or corrupt map file\n");
+		close(fd);
+		return (false);
+	}
+	base = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		printf("Failed to map %s\n", filename);
+		return (false);
+	}
+	header = (const MapFileHeader *)base;
+	if (!check_map_header(header, info.st_size))
+	{
+		munmap(base, info.st_size);
+		return (false);
+	}
+
+	map->width = header->width;
+	map->height = header->height;
+	map->chunksX = (map->width + MAP_CHUNK_MASK) >> MAP_CHUNK_SHIFT;
+	map->tiles = base + header->tilesOffset;
+	map->pager = NULL;
+	map->distance = header->distanceOffset ?
+		base + header->distanceOffset : NULL;
+	map->revision = 0;
+	if (!init_chunk_table(map, map->tiles))
+	{
+		printf("Out of memory for a %dx%d map\n", map->width, map->height);
+		munmap(base, info.st_size);
+		return (false);
+	}
+	memcpy(map->tileFlags, header->tileFlags, sizeof(map->tileFlags));
+	map->playerSpawn = header->playerSpawn;
+	map->enemySpawns = (Vec2F *)(base + sizeof(MapFileHeader));
+	map->numEnemySpawns = header->numEnemySpawns;
+	map->mapping = base;
+	map->mappingSize = info.st_size;
+	if (!check_player_spawn(map))
+	{
+		free_map(map);
+		return (false);
+	}
+	return (true);
+}
+
+/**
+ * save_binary_map - Writes a map in the binary format load_binary_map reads
+ * @filename: The name of the file to write.
+ * @map: The map to write; its distance field is written too, if built.
+ * Return: true if the whole file was written, false otherwise.
  */
+bool save_binary_map(const char *filename, const Map *map)
+{
+	FILE *file = fopen(filename, "wb");
+	MapFileHeader header = {.version = MAP_VERSION};
+	size_t spawnsEnd;
+	bool ok;
+
+	if (!file)
+	{
+		printf("Failed to open %s for writing\n", filename);
+		return (false);
+	}
+	memcpy(header.magic, MAP_MAGIC, sizeof(header.magic));
+	header.width = map->width;
+	header.height = map->height;
+	header.chunkShift = MAP_CHUNK_SHIFT;
+	header.numEnemySpawns = map->numEnemySpawns;
+	spawnsEnd = sizeof(header) + map->numEnemySpawns * sizeof(Vec2F);
+	header.tilesOffset = (spawnsEnd + MAP_TILES_ALIGN - 1) &
+		~(size_t)(MAP_TILES_ALIGN - 1);
+	header.tilesSize = map_tiles_size(map);
+	if (map->distance)
+		header.distanceOffset = (header.tilesOffset + header.tilesSize +
+			MAP_TILES_ALIGN - 1) & ~(uint64_t)(MAP_TILES_ALIGN - 1);
+	header.playerSpawn = map->playerSpawn;
+	memcpy(header.tileFlags, map->tileFlags, sizeof(header.tileFlags));
 
-bool load_map(const char *filename, uint8_t (*MAP)[MAP_SIZE * MAP_SIZE])
+	ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(map->numEnemySpawns == 0 || (size_t)fwrite(map->enemySpawns,
+			sizeof(Vec2F), map->numEnemySpawns, file) ==
+			(size_t)map->numEnemySpawns);
+	for (size_t i = spawnsEnd; ok && i < header.tilesOffset; i++)
+		ok = fputc(0, file) != EOF;
+	for (int i = 0; ok && i < map_chunk_count(map); i++)
+	{
+		static const uint8_t empty[MAP_CHUNK_SIZE * MAP_CHUNK_SIZE];
+
+		ok = fwrite(map->chunks[i] ? map->chunks[i] : empty,
+			sizeof(empty), 1, file) == 1;
+	}
+	for (uint64_t i = header.tilesOffset + header.tilesSize;
+		ok && i < header.distanceOffset; i++)
+		ok = fputc(0, file) != EOF;
+	if (ok && map->distance)
+		ok = fwrite(map->distance, (size_t)map->width * map->height, 1,
+			file) == 1;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		printf("Failed to write %s\n", filename);
+	return (ok);
+}
+
+/**
+ * read_map_file - Loads a map from a binary or whitespace-separated text
+ * file, without checking the player spawn of a text map.
+ * @filename: The name of the file containing the map data.
+ * @map: Where the map is stored; free it with free_map().
+ * Return: true if the map is loaded successfully, false otherwise.
+ * Description: Files starting with MAP_MAGIC are mapped with
+ * load_binary_map(). Otherwise every non-empty line is one row of tiles.
+ * The width is the number of values on a row and the height the number of
+ * rows; all rows must have the same width. Text maps get the distance
+ * field used to skip empty space while casting rays built once the tiles
+ * are loaded; binary maps bring it baked in, so they stay zero-copy.
+ */
+bool read_map_file(const char *filename, Map *map)
 {
 	FILE *file = fopen(filename, "r");
+	char magic[sizeof(MAP_MAGIC)] = {0};
+	int width, height;
 
 	if (!file)
 	{
 		printf("Failed to open map file: %s\n", filename);
 		return (false);
 	}
-
-	for (int i = 0; i < MAP_SIZE * MAP_SIZE; i++)
+	if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+		memcmp(magic, MAP_MAGIC, sizeof(magic)) == 0)
 	{
-		if (fscanf(file, "%hhu", &(*MAP)[i]) != 1)
+		fclose(file);
+		if (!load_binary_map(filename, map))
+			return (false);
+	}
+	else
+	{
+		rewind(file);
+		if (!measure_map(file, &width, &height) ||
+			!init_map(map, width, height))
 		{
-			printf("Failed to read map data at index %d\n", i);
 			fclose(file);
 			return (false);
 		}
+		rewind(file);
+		fill_map(file, map);
+		fclose(file);
+		if (!build_distance_field(map))
+			printf("Out of memory for the distance field, not skipping "
+				"space\n");
 	}
-
-	fclose(file);
 	return (true);
 }
+
+/**
+ * load_map - Loads a map the player can start on.
+ * @filename: The name of the file containing the map data.
+ * @map: Where the map is stored; free it with free_map().
+ * Return: true if the map is loaded and its player spawn is an empty cell
+ * inside it, false otherwise.
+ * Description: See read_map_file(); a text map has no spawn of its own,
+ * so the player starts at the one init_map() sets.
+ */
+bool load_map(const char *filename, Map *map)
+{
+	if (!read_map_file(filename, map))
+		return (false);
+	if (check_player_spawn(map))
+		return (true);
+	free_map(map);
+	return (false);
+}
@@ -0,0 +1,373 @@
+#include "structure.h"
+
+/* Size of a font pixel of the overlay on screen */
+#define OVERLAY_SCALE 2
+#define OVERLAY_LINE (7 * OVERLAY_SCALE)
+/* Height of the frame time graph, and the frame time at its top in ms */
+#define GRAPH_H 60
+#define GRAPH_MS 33.3
+
+static const char *const stageNames[NumProfileStages] = {
+	"events", "input", "movement", "enemies", "paging", "assets", "floor",
+	"raycast", "walls", "sprites", "map", "weapon", "overlay", "present"
+};
+
+static const char *const counterNames[NumProfileCounters] = {
+	"rays", "dda_steps", "draw_calls", "texture_binds"
+};
+
+/* Graph colors of the stages, in stage order */
+static const ColorRGBA stageColors[NumProfileStages] = {
+	{0x80, 0x80, 0x80, 0xFF}, {0xFF, 0xFF, 0x60, 0xFF},
+	{0xFF, 0xC0, 0x40, 0xFF}, {0xFF, 0x80, 0x40, 0xFF},
+	{0xC0, 0x60, 0xFF, 0xFF}, {0x60, 0xFF, 0x90, 0xFF},
+	{0x40, 0xC0, 0x40, 0xFF}, {0x40, 0xA0, 0xFF, 0xFF},
+	{0x40, 0xFF, 0xFF, 0xFF}, {0xFF, 0x40, 0x40, 0xFF},
+	{0xA0, 0xA0, 0x60, 0xFF}, {0xFF, 0x60, 0xC0, 0xFF},
+	{0x60, 0x60, 0x60, 0xFF}, {0xFF, 0xFF, 0xFF, 0xFF}
+};
+
+/**
+ * create_profiler - Allocates an empty profiler.
+ * Return: The profiler; free it with free().
+ */
+Profiler *create_profiler(void)
+{
+	Profiler *profiler = calloc(1, sizeof(Profiler));
+
+	ASSERT(profiler, "Out of memory for the profiler\n");
+	return (profiler);
+}
+
+/**
+ * profile_begin_frame - Starts recording a new frame.
+ * @state: The game state.
+ */
+void profile_begin_frame(State *state)
+{
+	ProfileFrame *frame;
+
+	if (!state->profiling)
+		return;
+	frame = &state->profiler->frames[state->profiler->current];
+	memset(frame, 0, sizeof(ProfileFrame));
+	frame->start = SDL_GetPerformanceCounter();
+	state->profiler->lastTexture = NULL;
+}
+
+/**
+ * profile_end_frame - Completes the frame being recorded.
+ * @state: The game state.
+ * Description: The oldest frame is overwritten once PROFILE_FRAMES frames
+ * have been recorded. The ring holds one frame more than that, so the
+ * frame being recorded never takes the slot of a completed one.
+ */
+void profile_end_frame(State *state)
+{
+	Profiler *profiler = state->profiler;
+
+	if (!state->profiling)
+		return;
+	profiler->frames[profiler->current].end = SDL_GetPerformanceCounter();
+	profiler->current = (profiler->current + 1) % (PROFILE_FRAMES + 1);
+	profiler->count = MIN(profiler->count + 1, PROFILE_FRAMES);
+}
+
+/**
+ * record_profile_scope - Adds a finished scope to the current frame.
+ * @profiler: The profiler.
+ * @stage: The stage the scope belongs to.
+ * @start: Performance counter at the start of the scope.
+ */
+void record_profile_scope(Profiler *profiler, ProfileStage stage,
+	Uint64 start)
+{
+	ProfileFrame *frame = &profiler->frames[profiler->current];
+	Uint64 end = SDL_GetPerformanceCounter();
+
+	frame->stageTicks[stage] += end - start;
+	if (frame->numEvents < PROFILE_EVENTS)
+		frame->events[frame->numEvents++] = (ProfileEvent) {stage, start, end};
+}
+
+/**
+ * completed_frame - Gets a completed frame, oldest first.
+ * @profiler: The profiler.
+ * @i: The index of the frame, from 0 to profiler->count - 1.
+ * Return: The frame.
+ */
+static const ProfileFrame *completed_frame(const Profiler *profiler, int i)
+{
+	return (&profiler->frames[(profiler->current - profiler->count + i +
+		PROFILE_FRAMES + 1) % (PROFILE_FRAMES + 1)]);
+}
+
+/**
+ * ticks_to_ms - Converts performance counter ticks to milliseconds.
+ * @ticks: The ticks.
+ * Return: The milliseconds.
+ */
+static double ticks_to_ms(Uint64 ticks)
+{
+	return ((double)ticks * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+/**
+ * compare_ticks - Orders tick counts from short to long for qsort.
+ * @a: The first Uint64.
+ * @b: The second Uint64.
+ * Return: Negative, zero or positive as @a is shorter, equal or longer.
+ */
+static int compare_ticks(const void *a, const void *b)
+{
+	Uint64 ta = *(const Uint64 *)a, tb = *(const Uint64 *)b;
+
+	return ((ta > tb) - (ta < tb));
+}
+
+/**
+ * glyph - Looks up the 3x5 bitmap of a character of the overlay font.
+ * @c: The character; lowercase letters are drawn as capitals.
+ * Return: 15 bits, 3 per row from the top, the high bit leftmost; 0 for
+ * characters the font lacks.
+ */
+static int glyph(char c)
+{
+	static const char chars[] = "0123456789.:/-_%ABCDEFGHIKLMNOPRSTUVWXY";
+	static const unsigned short bits[] = {
+		075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111,
+		075757, 075717, 000002, 002020, 011244, 000700, 000007, 051245,
+		025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755,
+		072227, 055655, 044447, 057755, 065555, 025552, 065644, 065655,
+		034216, 072222, 055557, 055552, 055775, 055255, 055222
+	};
+	const char *found;
+
+	if (c >= 'a' && c <= 'z')
+		c -= 'a' - 'A';
+	found = c ? strchr(chars, c) : NULL;
+	return (found ? bits[found - chars] : 0);
+}
+
+/**
+ * draw_text - Draws a line of text with the overlay font.
+ * @state: The game state holding the renderer.
+ * @x: Left edge of the text on screen.
+ * @y: Top edge of the text on screen.
+ * @text: The text.
+ * Description: Every lit font pixel becomes one rectangle, and the whole
+ * line is submitted with a single SDL_RenderFillRects.
+ */
+static void draw_text(State *state, int x, int y, const char *text)
+{
+	SDL_Rect rects[64 * 15];
+	int count = 0;
+
+	for (int i = 0; text[i] && i < 64; i++)
+	{
+		int bits = glyph(text[i]);
+
+		for (int bit = 0; bit < 15; bit++)
+			if (bits & (1 << (14 - bit)))
+				rects[count++] = (SDL_Rect) {
+					x + (i * 4 + bit % 3) * OVERLAY_SCALE,
+					y + bit / 3 * OVERLAY_SCALE, OVERLAY_SCALE, OVERLAY_SCALE};
+	}
+	SDL_RenderFillRects(state->renderer, rects, count);
+	profile_draw(state, NULL);
+}
+
+/**
+ * draw_frame_graph - Draws the time of every recorded frame as a bar.
+ * @state: The game state.
+ * @x: Left edge of the graph on screen.
+ * @y: Top edge of the graph on screen.
+ * Description: Bars are stacked by stage in the colors of the legend, with
+ * the time outside any stage on top in dark grey.
+ */
+static void draw_frame_graph(State *state, int x, int y)
+{
+	const Profiler *profiler = state->profiler;
+	double scale = GRAPH_H / GRAPH_MS;
+
+	for (int i = 0; i < profiler->count; i++)
+	{
+		const ProfileFrame *frame = completed_frame(profiler, i);
+		int bottom = y + GRAPH_H;
+		int total = MIN((int)(ticks_to_ms(frame->end - frame->start) * scale),
+			GRAPH_H);
+
+		SDL_SetRenderDrawColor(state->renderer, 0x30, 0x30, 0x30, 0xFF);
+		SDL_RenderDrawLine(state->renderer, x + i, bottom - total, x + i,
+			bottom);
+		profile_draw(state, NULL);
+		for (int s = 0; s < NumProfileStages; s++)
+		{
+			int h = (int)(ticks_to_ms(frame->stageTicks[s]) * scale);
+
+			h = MIN(h, bottom - (y + GRAPH_H - total));
+			if (h <= 0)
+				continue;
+			SDL_SetRenderDrawColor(state->renderer, stageColors[s].r,
+				stageColors[s].g, stageColors[s].b, 0xFF);
+			SDL_RenderDrawLine(state->renderer, x + i, bottom - h, x + i,
+				bottom - 1);
+			profile_draw(state, NULL);
+			bottom -= h;
+		}
+	}
+}
+
+/**
+ * draw_profiler_overlay - Draws the profiler statistics over the frame.
+ * @state: The game state.
+ * Description: Shows the p50 and p99 frame times of the recorded frames,
+ * the counters, the resolution of the 3D view, per-stage averages, and a
+ * graph of every recorded frame. Drawn only while profiling; it is timed
+ * as its own stage.
+ */
+void draw_profiler_overlay(State *state)
+{
+	const Profiler *profiler = state->profiler;
+	Uint64 totals[PROFILE_FRAMES], stageSums[NumProfileStages] = {0};
+	Uint64 start = profile_begin(state);
+	const ProfileFrame *last;
+	char line[64];
+	int y = 8;
+	SDL_Rect panel = {4, 4, 280, 5 * OVERLAY_LINE + NumProfileStages *
+		OVERLAY_LINE + GRAPH_H + 12};
+
+	if (!state->profiling || profiler->count == 0)
+		return;
+	last = completed_frame(profiler, profiler->count - 1);
+	for (int i = 0; i < profiler->count; i++)
+	{
+		const ProfileFrame *frame = completed_frame(profiler, i);
+
+		totals[i] = frame->end - frame->start;
+		for (int s = 0; s < NumProfileStages; s++)
+			stageSums[s] += frame->stageTicks[s];
+	}
+	qsort(totals, profiler->count, sizeof(Uint64), compare_ticks);
+
+	SDL_SetRenderDrawBlendMode(state->renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(state->renderer, 0x00, 0x00, 0x00, 0xB0);
+	SDL_RenderFillRect(state->renderer, &panel);
+	profile_draw(state, NULL);
+	SDL_SetRenderDrawBlendMode(state->renderer, SDL_BLENDMODE_NONE);
+	SDL_SetRenderDrawColor(state->renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+	snprintf(line, sizeof(line), "frame p50 %.2f p99 %.2f ms",
+		ticks_to_ms(totals[profiler->count / 2]),
+		ticks_to_ms(totals[(profiler->count - 1) * 99 / 100]));
+	draw_text(state, 8, y, line);
+	snprintf(line, sizeof(line), "rays %u dda %u",
+		last->counters[CounterRays], last->counters[CounterDdaSteps]);
+	draw_text(state, 8, y += OVERLAY_LINE, line);
+	snprintf(line, sizeof(line), "draws %u binds %u",
+		last->counters[CounterDrawCalls], last->counters[CounterTextureBinds]);
+	draw_text(state, 8, y += OVERLAY_LINE, line);
+	snprintf(line, sizeof(line), "view %dx%d render %.2f ms", state->viewW,
+		state->viewH, state->scaler.averageMs);
+	draw_text(state, 8, y += OVERLAY_LINE, line);
+	y += OVERLAY_LINE / 2;
+	for (int s = 0; s < NumProfileStages; s++)
+	{
+		SDL_Rect swatch = {8, y += OVERLAY_LINE, 8, 5 * OVERLAY_SCALE};
+
+		SDL_SetRenderDrawColor(state->renderer, stageColors[s].r,
+			stageColors[s].g, stageColors[s].b, 0xFF);
+		SDL_RenderFillRect(state->renderer, &swatch);
+		profile_draw(state, NULL);
+		snprintf(line, sizeof(line), "%-9s %6.3f ms", stageNames[s],
+			ticks_to_ms(stageSums[s]) / profiler->count);
+		draw_text(state, 20, y, line);
+	}
+	draw_frame_graph(state, 12, y + OVERLAY_LINE + 4);
+	profile_end(state, StageOverlay, start);
+}
+
+/**
+ * export_profile_csv - Writes the recorded frames as CSV.
+ * @profiler: The profiler.
+ * @path: The file to write.
+ * Return: true if the file was written, false otherwise.
+ * Description: One row per frame, oldest first: the frame time and the
+ * time of every stage in milliseconds, then every counter.
+ */
+bool export_profile_csv(const Profiler *profiler, const char *path)
+{
+	FILE *file = fopen(path, "w");
+
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		return (false);
+	}
+	fprintf(file, "frame,frame_ms");
+	for (int s = 0; s < NumProfileStages; s++)
+		fprintf(file, ",%s_ms", stageNames[s]);
+	for (int c = 0; c < NumProfileCounters; c++)
+		fprintf(file, ",%s", counterNames[c]);
+	fprintf(file, "\n");
+	for (int i = 0; i < profiler->count; i++)
+	{
+		const ProfileFrame *frame = completed_frame(profiler, i);
+
+		fprintf(file, "%d,%.4f", i, ticks_to_ms(frame->end - frame->start));
+		for (int s = 0; s < NumProfileStages; s++)
+			fprintf(file, ",%.4f", ticks_to_ms(frame->stageTicks[s]));
+		for (int c = 0; c < NumProfileCounters; c++)
+			fprintf(file, ",%u", frame->counters[c]);
+		fprintf(file, "\n");
+	}
+	return (fclose(file) == 0);
+}
+
+/**
+ * export_profile_trace - Writes the recorded frames as a Chrome trace.
+ * @profiler: The profiler.
+ * @path: The file to write; open it in chrome://tracing or Perfetto.
+ * Return: true if the file was written, false otherwise.
+ * Description: Every frame and every recorded scope becomes a complete
+ * ("X") event, and the counters of each frame a counter ("C") event.
+ */
+bool export_profile_trace(const Profiler *profiler, const char *path)
+{
+	FILE *file = fopen(path, "w");
+	Uint64 origin;
+	double usPerTick = 1e6 / SDL_GetPerformanceFrequency();
+	const char *separator = "";
+
+	if (!file)
+	{
+		fprintf(stderr, "Failed to open %s for writing\n", path);
+		return (false);
+	}
+	origin = profiler->count ? completed_frame(profiler, 0)->start : 0;
+	fprintf(file, "{\"traceEvents\": [\n");
+	for (int i = 0; i < profiler->count; i++)
+	{
+		const ProfileFrame *frame = completed_frame(profiler, i);
+
+		fprintf(file, "%s{\"name\": \"frame\", \"ph\": \"X\", \"pid\": 1, "
+			"\"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}", separator,
+			(frame->start - origin) * usPerTick,
+			(frame->end - frame->start) * usPerTick);
+		separator = ",\n";
+		for (int e = 0; e < frame->numEvents; e++)
+			fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+				"\"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}", separator,
+				stageNames[frame->events[e].stage],
+				(frame->events[e].start - origin) * usPerTick,
+				(frame->events[e].end - frame->events[e].start) * usPerTick);
+		fprintf(file, "%s{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, "
+			"\"ts\": %.3f, \"args\": {", separator,
+			(frame->start - origin) * usPerTick);
+		for (int c = 0; c < NumProfileCounters; c++)
+			fprintf(file, "%s\"%s\": %u", c ? ", " : "", counterNames[c],
+				frame->counters[c]);
+		fprintf(file, "}}");
+	}
+	fprintf(file, "\n]}\n");
+	return (fclose(file) == 0);
+}
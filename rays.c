@@ -0,0 +1,252 @@
+#include "structure.h"
+
+/* Rays claimed at a time by a thread; smaller batches run on the caller */
+#define RAY_CHUNK 256
+
+/**
+ * struct RayJob - A batch of ray queries shared by the pool threads
+ * @map: The map the rays are traced through.
+ * @rays: The queries.
+ * @hits: Where the hit of each query is stored, NULL for occlusion tests.
+ * @blocked: Where each occlusion result is stored, NULL for full casts.
+ * @count: The number of queries.
+ * @next: The first query not yet claimed by a thread.
+ */
+typedef struct RayJob
+{
+	const Map *map;
+	const RayQuery *rays;
+	RayHit *hits;
+	bool *blocked;
+	int count;
+	SDL_atomic_t next;
+} RayJob;
+
+/**
+ * struct RayState - A ray being traced by trace_ray()
+ * @dir: Unit direction of the ray.
+ * @cell: The cell the ray is in.
+ * @sideDist: Distance along the ray to the next x and y grid lines.
+ * @deltaDist: Distance along the ray between two x or y grid lines.
+ * @stepDir: Direction the ray steps in along x and y.
+ * @side: The kind of grid line crossed last.
+ */
+typedef struct RayState
+{
+	Vec2F dir;
+	Vec2I cell;
+	Vec2F sideDist;
+	Vec2F deltaDist;
+	Vec2I stepDir;
+	Side side;
+} RayState;
+
+/**
+ * start_ray - Sets up the DDA of a query from its own origin.
+ * @ray: The query.
+ * @state: Where the DDA state is stored.
+ * Return: false if the direction has no length.
+ * Description: The same setup as initialize_raycasting(), but from any
+ * origin and with the direction normalized, so every distance is in cells.
+ */
+static bool start_ray(const RayQuery *ray, RayState *state)
+{
+	float length = sqrtf(ray->dir.x * ray->dir.x + ray->dir.y * ray->dir.y);
+	float fx = floorf(ray->origin.x), fy = floorf(ray->origin.y);
+
+	if (length == 0.0f)
+		return (false);
+	state->dir = (Vec2F) {ray->dir.x / length, ray->dir.y / length};
+	state->cell = (Vec2I) {(int)fx, (int)fy};
+	state->deltaDist.x = state->dir.x == 0 ? 1e30 : fabsf(1 / state->dir.x);
+	state->deltaDist.y = state->dir.y == 0 ? 1e30 : fabsf(1 / state->dir.y);
+	state->stepDir.x = state->dir.x < 0 ? -1 : 1;
+	state->stepDir.y = state->dir.y < 0 ? -1 : 1;
+	state->sideDist.x = (state->dir.x < 0 ? ray->origin.x - fx :
+		fx + 1.0f - ray->origin.x) * state->deltaDist.x;
+	state->sideDist.y = (state->dir.y < 0 ? ray->origin.y - fy :
+		fy + 1.0f - ray->origin.y) * state->deltaDist.y;
+	state->side = EastWest;
+	return (true);
+}
+
+/**
+ * trace_ray - Steps a ray through the map until it enters a solid cell.
+ * @map: The map.
+ * @ray: The query.
+ * @state: The DDA state from start_ray(), left at the hit.
+ * Return: The distance along the ray the solid cell is entered at, or a
+ * negative value if there is none within ray->maxDistance. A ray starting
+ * in a solid cell hits it at distance 0.
+ * Description: Empty space is skipped with the distance field the same
+ * way perform_dda() does it.
+ */
+static float trace_ray(const Map *map, const RayQuery *ray, RayState *state)
+{
+	int reach = (int)ray->maxDistance + 1;
+
+	if (map_solid(map, state->cell.x, state->cell.y))
+		return (0.0f);
+	while (MIN(state->sideDist.x, state->sideDist.y) <= ray->maxDistance)
+	{
+		if (state->sideDist.x < state->sideDist.y)
+		{
+			state->sideDist.x += state->deltaDist.x;
+			state->cell.x += state->stepDir.x;
+			state->side = EastWest;
+		}
+		else
+		{
+			state->sideDist.y += state->deltaDist.y;
+			state->cell.y += state->stepDir.y;
+			state->side = NorthSouth;
+		}
+		if (!map->distance)
+		{
+			if (map_solid(map, state->cell.x, state->cell.y))
+				return (calculate_wall_distance(state->side,
+					&state->sideDist, &state->deltaDist));
+			continue;
+		}
+		int distance = map_distance(map, state->cell.x, state->cell.y);
+
+		if (distance == 0)
+			return (calculate_wall_distance(state->side, &state->sideDist,
+				&state->deltaDist));
+		/* No axis moves more than maxDistance + 1 cells before the end */
+		if (distance > 1)
+			skip_empty_cells(&state->cell, &state->sideDist,
+				&state->deltaDist, &state->stepDir, &state->side,
+				MIN(distance - 1, reach));
+	}
+	return (-1.0f);
+}
+
+/**
+ * cast_ray - Answers one full ray query.
+ * @map: The map.
+ * @ray: The query.
+ * @hit: Where the answer is stored.
+ */
+static void cast_ray(const Map *map, const RayQuery *ray, RayHit *hit)
+{
+	RayState state;
+	float distance;
+
+	hit->hit = false;
+	if (!start_ray(ray, &state) || (distance = trace_ray(map, ray,
+		&state)) < 0.0f)
+		return;
+	hit->hit = true;
+	hit->cell = state.cell;
+	hit->side = state.side;
+	hit->distance = distance;
+	hit->point = (Vec2F) {ray->origin.x + state.dir.x * distance,
+		ray->origin.y + state.dir.y * distance};
+}
+
+/**
+ * ray_blocked - Answers one occlusion query.
+ * @map: The map.
+ * @ray: The query.
+ * Return: true if a solid cell lies within ray->maxDistance.
+ * Description: The cells a ray crosses lie in the box between the cells of
+ * its two ends. When the distance field shows that box is empty around
+ * either end, the ray is not traced at all.
+ */
+static bool ray_blocked(const Map *map, const RayQuery *ray)
+{
+	RayState state;
+
+	if (!start_ray(ray, &state))
+		return (map_solid(map, (int)floorf(ray->origin.x),
+			(int)floorf(ray->origin.y)));
+	if (map->distance)
+	{
+		int endX = (int)floorf(ray->origin.x + state.dir.x * ray->maxDistance);
+		int endY = (int)floorf(ray->origin.y + state.dir.y * ray->maxDistance);
+		int span = MAX(abs(endX - state.cell.x), abs(endY - state.cell.y));
+
+		if (span < map_distance(map, state.cell.x, state.cell.y) ||
+			span < map_distance(map, endX, endY))
+			return (false);
+	}
+	return (trace_ray(map, ray, &state) >= 0.0f);
+}
+
+/**
+ * ray_task - Claims chunks of queries and answers them until none are left.
+ * @arg: The RayJob of the batch.
+ */
+static void ray_task(void *arg)
+{
+	RayJob *job = arg;
+	int start;
+
+	while ((start = SDL_AtomicAdd(&job->next, RAY_CHUNK)) < job->count)
+	{
+		int end = MIN(start + RAY_CHUNK, job->count);
+
+		for (int i = start; i < end; i++)
+		{
+			if (job->blocked)
+				job->blocked[i] = ray_blocked(job->map, &job->rays[i]);
+			else
+				cast_ray(job->map, &job->rays[i], &job->hits[i]);
+		}
+	}
+}
+
+/**
+ * run_ray_job - Answers a batch of queries on the pool.
+ * @pool: The pool, or NULL to answer them on the calling thread.
+ * @job: The batch.
+ */
+static void run_ray_job(ThreadPool *pool, RayJob *job)
+{
+	SDL_AtomicSet(&job->next, 0);
+	if (pool && job->count > RAY_CHUNK)
+		thread_pool_run(pool, ray_task, job);
+	else
+		ray_task(job);
+}
+
+/**
+ * cast_rays - Finds where each of a batch of rays first hits a wall.
+ * @pool: The thread pool to spread the batch over, or NULL.
+ * @map: The map, only read.
+ * @rays: The queries; directions need not be unit length, distances are
+ * in cells along the ray.
+ * @count: The number of queries.
+ * @hits: Where the answer to each query is stored.
+ * Description: Cells outside the map and cells not resident in a paged
+ * map count as solid, as they do for the renderer.
+ */
+void cast_rays(ThreadPool *pool, const Map *map, const RayQuery *rays,
+	int count, RayHit *hits)
+{
+	RayJob job = {.map = map, .rays = rays, .hits = hits, .count = count};
+
+	run_ray_job(pool, &job);
+}
+
+/**
+ * test_occlusion - Checks a batch of rays for any wall within their length.
+ * @pool: The thread pool to spread the batch over, or NULL.
+ * @map: The map, only read.
+ * @rays: The queries; for line of sight from a to b, origin a, direction
+ * b - a and maxDistance |b - a|.
+ * @count: The number of queries.
+ * @blocked: Where whether each ray is blocked is stored.
+ * Description: Cheaper than cast_rays(): nothing about the hit is
+ * computed, and rays that stay within the empty space around their origin
+ * are answered from the distance field without stepping.
+ */
+void test_occlusion(ThreadPool *pool, const Map *map, const RayQuery *rays,
+	int count, bool *blocked)
+{
+	RayJob job = {.map = map, .rays = rays, .blocked = blocked,
+		.count = count};
+
+	run_ray_job(pool, &job);
+}
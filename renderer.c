@@ -6,15 +6,16 @@
  * @player: A pointer to the Player structure
  * containing the player's direction and plane vectors.
  * @x: The x-coordinate on the screen for which the ray direction is calculated
+ * @width: The number of columns the view is cast with.
  * Return: The calculated direction of the ray as a Vec2F structure.
  * Description: This function calculates the direction of a ray based on the
  * player's position and the x-coordinate on the screen. It uses the player's
  * direction and plane vectors along with the cameraX value derived from the
  * screen coordinate to compute the ray direction.
  */
-Vec2F calculate_ray_direction(Player *player, int x)
+Vec2F calculate_ray_direction(Player *player, int x, int width)
 {
-	float cameraX = 2 * x / (float)SCREEN_W - 1;
+	float cameraX = 2 * x / (float)width - 1;
 	Vec2F rayDir = {
 		.x = player->dir.x + player->plane.x * cameraX,
 		.y = player->dir.y + player->plane.y * cameraX,
@@ -22,6 +23,51 @@ Vec2F calculate_ray_direction(Player *player, int x)
 	return (rayDir);
 }
 
+/**
+ * skip_empty_cells - Takes every DDA step that stays within a distance.
+ * @mapBox: Pointer to the current map coordinates.
+ * @sideDist: Pointer to distances to the nearest grid lines.
+ * @deltaDist: Pointer to distances between grid lines.
+ * @stepDir: Pointer to step directions in x and y axes.
+ * @side: Pointer to store which side of the wall was crossed last.
+ * @cells: How many cells the ray may move along each axis; all of them are
+ * known to be empty.
+ * Description: The DDA takes the x and y steps in increasing order of
+ * their sideDist, so all the steps below a threshold are a prefix of the
+ * ones perform_dda() would take. The threshold is the sideDist of step
+ * @cells + 1 on whichever axis reaches it first, and each axis is advanced
+ * with the same float additions the DDA makes, so the state afterwards is
+ * bit for bit the one the DDA reaches one step at a time.
+ */
+void skip_empty_cells(Vec2I *mapBox, Vec2F *sideDist,
+	Vec2F *deltaDist, Vec2I *stepDir, Side *side, int cells)
+{
+	Vec2F limit = *sideDist;
+	float threshold, lastX = -1.0f, lastY = -1.0f;
+
+	for (int i = 0; i < cells; i++)
+	{
+		limit.x += deltaDist->x;
+		limit.y += deltaDist->y;
+	}
+	threshold = MIN(limit.x, limit.y);
+	while (sideDist->x < threshold)
+	{
+		lastX = sideDist->x;
+		sideDist->x += deltaDist->x;
+		mapBox->x += stepDir->x;
+	}
+	while (sideDist->y < threshold)
+	{
+		lastY = sideDist->y;
+		sideDist->y += deltaDist->y;
+		mapBox->y += stepDir->y;
+	}
+	/* On a tie the DDA steps y first, so x was the later step */
+	if (lastX >= 0.0f || lastY >= 0.0f)
+		*side = (lastX >= lastY) ? EastWest : NorthSouth;
+}
+
 /**
  * perform_dda - Performs the DDA algorithm to find where the ray hits a wall.
  * @mapBox: Pointer to the current map coordinates.
@@ -29,15 +75,18 @@ Vec2F calculate_ray_direction(Player *player, int x)
  * @deltaDist: Pointer to distances between grid lines.
  * @stepDir: Pointer to step directions in x and y axes.
  * @side: Pointer to store which side of the wall was hit.
- * @MAP: the map which is used during the game.
- * Return: True if a wall is hit, false otherwise.
+ * @map: the map which is used during the game.
+ * Return: The number of cells looked up before the wall was hit.
+ * Description: When the map has a distance field, cells far from any wall
+ * are crossed several at a time by skip_empty_cells(); the hit is
+ * identical either way.
  */
-bool perform_dda(Vec2I *mapBox, Vec2F *sideDist, Vec2F *deltaDist,
-	Vec2I *stepDir, Side *side, uint8_t MAP[MAP_SIZE * MAP_SIZE])
+int perform_dda(Vec2I *mapBox, Vec2F *sideDist, Vec2F *deltaDist,
+	Vec2I *stepDir, Side *side, const Map *map)
 {
-	bool hit = false;
+	int steps = 0;
 
-	while (!hit)
+	while (true)
 	{
 		if (sideDist->x < sideDist->y)
 		{
@@ -51,10 +100,21 @@ bool perform_dda(Vec2I *mapBox, Vec2F *sideDist, Vec2F *deltaDist,
 			mapBox->y += stepDir->y;
 			*side = NorthSouth;
 		}
-		if (MAP[xy2index(mapBox->x, mapBox->y, MAP_SIZE)] > 0)
-			hit = true;
+		steps++;
+		if (!map->distance)
+		{
+			if (map_solid(map, mapBox->x, mapBox->y))
+				return (steps);
+			continue;
+		}
+		int distance = map_distance(map, mapBox->x, mapBox->y);
+
+		if (distance == 0)
+			return (steps);
+		if (distance > 1)
+			skip_empty_cells(mapBox, sideDist, deltaDist, stepDir, side,
+				distance - 1);
 	}
-	return (hit);
 }
 
 /**
@@ -76,108 +136,518 @@ float calculate_wall_distance(Side side, Vec2F *sideDist, Vec2F *deltaDist)
 	return (perpWallDist);
 }
 
+/**
+ * cast_column - Casts the ray of one screen column and records its hit.
+ * @player: Pointer to the Player structure the ray starts from.
+ * @x: The x-coordinate of the column on the screen.
+ * @width: The number of columns the view is cast with.
+ * @map: the map which is used during the game.
+ * @hit: Where the hit of the ray is stored.
+ * Description: Only reads @player and @map, so columns can be cast from
+ * several threads at once.
+ */
+void cast_column(Player *player, int x, int width, const Map *map,
+	ColumnHit *hit)
+{
+	Vec2F rayDir = calculate_ray_direction(player, x, width);
+	Vec2F sideDist = {0.0f, 0.0f};
+	Vec2F deltaDist;
+	Vec2I stepDir;
+	float wallX;
+
+	initialize_raycasting(player, rayDir,
+		&hit->mapBox, &sideDist, &deltaDist, &stepDir);
+	hit->steps = perform_dda(&hit->mapBox, &sideDist, &deltaDist, &stepDir,
+		&hit->side, map);
+	hit->distance = calculate_wall_distance(hit->side, &sideDist, &deltaDist);
+
+	wallX = (hit->side == EastWest) ? player->pos.y +
+		hit->distance * rayDir.y : player->pos.x + hit->distance * rayDir.x;
+	hit->wallX = wallX - floorf(wallX);
+}
+
+/**
+ * cast_packet - Casts the rays of 8 adjacent columns with the AVX2 DDA.
+ * @player: Pointer to the Player structure the rays start from.
+ * @x: The first of the 8 columns.
+ * @width: The number of columns the view is cast with.
+ * @map: the map which is used during the game.
+ * @hits: Where the hits of the 8 rays are stored.
+ * Description: Produces exactly what cast_column() would for each column.
+ */
+static void cast_packet(Player *player, int x, int width, const Map *map,
+	ColumnHit hits[8])
+{
+	Vec2F rayDir[8], sideDist[8], deltaDist[8];
+	Vec2I mapBox[8], stepDir[8];
+	Side side[8];
+
+	for (int i = 0; i < 8; i++)
+	{
+		rayDir[i] = calculate_ray_direction(player, x + i, width);
+		sideDist[i] = (Vec2F) {0.0f, 0.0f};
+		initialize_raycasting(player, rayDir[i],
+			&mapBox[i], &sideDist[i], &deltaDist[i], &stepDir[i]);
+	}
+	perform_dda_avx2(mapBox, sideDist, deltaDist, stepDir, side, map);
+	for (int i = 0; i < 8; i++)
+	{
+		float wallX;
+
+		hits[i].steps = abs(mapBox[i].x - (int)player->pos.x) +
+			abs(mapBox[i].y - (int)player->pos.y);
+		hits[i].mapBox = mapBox[i];
+		hits[i].side = side[i];
+		hits[i].distance = calculate_wall_distance(side[i],
+			&sideDist[i], &deltaDist[i]);
+		wallX = (side[i] == EastWest) ? player->pos.y +
+			hits[i].distance * rayDir[i].y :
+			player->pos.x + hits[i].distance * rayDir[i].x;
+		hits[i].wallX = wallX - floorf(wallX);
+	}
+}
+
+/**
+ * struct RaycastJob - Work shared by the threads casting one frame
+ * @player: The player the rays start from.
+ * @map: the map which is used during the game.
+ * @hits: The per-column output buffer.
+ * @width: The number of columns to cast.
+ * @simdDda: Whether to cast 8 columns at a time with the AVX2 DDA.
+ * @nextColumn: The first column not yet claimed by a thread.
+ */
+typedef struct RaycastJob
+{
+	Player *player;
+	const Map *map;
+	ColumnHit *hits;
+	int width;
+	bool simdDda;
+	SDL_atomic_t nextColumn;
+} RaycastJob;
+
+#define RAYCAST_CHUNK 32
+/* Frames each DDA kernel casts while choose_dda_kernel() times them */
+#define DDA_TRIALS 5
+
+/**
+ * raycast_task - Claims chunks of columns and casts them until none are left.
+ * @arg: The RaycastJob of the current frame.
+ */
+static void raycast_task(void *arg)
+{
+	RaycastJob *job = arg;
+	int start;
+
+	while ((start = SDL_AtomicAdd(&job->nextColumn, RAYCAST_CHUNK)) <
+		job->width)
+	{
+		int end = MIN(start + RAYCAST_CHUNK, job->width);
+		int x = start;
+
+		if (job->simdDda)
+			for (; x + 8 <= end; x += 8)
+				cast_packet(job->player, x, job->width, job->map,
+					&job->hits[x]);
+		for (; x < end; x++)
+			cast_column(job->player, x, job->width, job->map, &job->hits[x]);
+	}
+}
+
+/**
+ * cast_columns - Casts the rays of every view column on the thread pool.
+ * @state: Pointer to the State holding the pool and the hit buffer.
+ * @player: Pointer to the Player structure the rays start from.
+ * @map: the map which is used during the game.
+ * Description: Threads claim chunks of RAYCAST_CHUNK columns at a time so
+ * cheap and expensive parts of the screen balance out; when this returns,
+ * state->columnHits holds the hit of every column. The AVX2 DDA looks up
+ * every cell, so it is only used on maps without a distance field, where
+ * skipping empty space is not possible, and where choose_dda_kernel()
+ * found it faster.
+ */
+void cast_columns(State *state, Player *player,
+	const Map *map)
+{
+	RaycastJob job = {.player = player, .map = map,
+		.hits = state->columnHits, .width = state->viewW,
+		.simdDda = state->simdDda && !map->distance};
+
+	SDL_AtomicSet(&job.nextColumn, 0);
+	thread_pool_run(state->pool, raycast_task, &job);
+	if (!state->profiling)
+		return;
+	profile_count(state, CounterRays, state->viewW);
+	for (int x = 0; x < state->viewW; x++)
+		profile_count(state, CounterDdaSteps, state->columnHits[x].steps);
+}
+
+/**
+ * choose_dda_kernel - Keeps the AVX2 DDA only where it beats the scalar one.
+ * @state: Pointer to the State; state->simdDda is updated.
+ * @player: Pointer to the Player structure the test rays start from.
+ * @map: the map which is used during the game.
+ * Description: With a distance field the scalar DDA crosses open space in
+ * jumps while the AVX2 kernel still visits every cell, so the scalar one
+ * is kept. Without one, as on paged maps, both kernels cast DDA_TRIALS
+ * frames of columns from the player and the faster one is kept; they hit
+ * the same walls, so only the speed differs.
+ */
+void choose_dda_kernel(State *state, Player *player, const Map *map)
+{
+	Uint64 best[2] = {UINT64_MAX, UINT64_MAX};
+	bool profiling = state->profiling;
+
+	if (!state->simdDda || map->distance)
+	{
+		state->simdDda = false;
+		return;
+	}
+	state->profiling = false;
+	for (int i = 0; i < 2 * DDA_TRIALS; i++)
+	{
+		Uint64 start = SDL_GetPerformanceCounter();
+
+		state->simdDda = i % 2;
+		cast_columns(state, player, map);
+		best[i % 2] = MIN(best[i % 2], SDL_GetPerformanceCounter() - start);
+	}
+	state->profiling = profiling;
+	state->simdDda = best[1] < best[0];
+}
+
+/**
+ * wall_light - Gets the light level a wall column is drawn at.
+ * @hit: The wall hit of the column.
+ * Return: The light level, dimmed with distance; NorthSouth faces get half
+ * of it, as they used to with SDL_SetTextureColorMod(128, 128, 128).
+ */
+int wall_light(const ColumnHit *hit)
+{
+	int light = light_level(LIGHT_FULL, hit->distance);
+
+	return (hit->side == NorthSouth ? light / 2 : light);
+}
+
 /**
  * render_column - Renders a vertical column of the screen.
  * @state: Pointer to the State structure containing the SDL
  * renderer and textures.
- * @x: The x-coordinate of the column to render on the screen.
- * @lineHeight: The height of the column, calculated based on the
- * distance to the wall.
- * @side: The side of the wall hit by the ray (North/South or East/West).
- * @mapBox: The map coordinates (grid position) of the wall hit by the ray.
- * @MAP: The 2D map array used during the game, which stores wall positions.
- * @perpWallDist: The perpendicular distance
- * from the player to the wall hit by the ray.
- * @rayDir: The direction of the ray used to calculate the wall hit.
- * @player: Pointer to the Player structure containing the player's position.
+ * @x: The x-coordinate of the column to render in the view.
+ * @hit: The wall hit of the ray cast for this column.
+ * @map: The 2D map array used during the game, which stores wall positions.
  * Return: None
  */
-void render_column(State *state, int x, int lineHeight, Side side,
-	Vec2I mapBox, uint8_t MAP[MAP_SIZE * MAP_SIZE], float perpWallDist,
-	Vec2F rayDir, Player *player)
+void render_column(State *state, int x, const ColumnHit *hit,
+	const Map *map)
 {
-	int drawStart, drawEnd;
+	int drawStart, drawEnd, lineHeight;
 	SDL_Rect srcRect, dstRect;
+	const Asset *asset;
 	SDL_Texture *texture;
+	Uint8 light;
 
-	drawStart = -lineHeight / 2 + SCREEN_H / 2;
+	lineHeight = (int)(state->viewH / hit->distance);
+	drawStart = -lineHeight / 2 + state->viewH / 2;
 	if (drawStart < 0)
 		drawStart = 0;
-	drawEnd = lineHeight / 2 + SCREEN_H / 2;
-	if (drawEnd >= SCREEN_H)
-		drawEnd = SCREEN_H;
+	drawEnd = lineHeight / 2 + state->viewH / 2;
+	if (drawEnd >= state->viewH)
+		drawEnd = state->viewH;
 
 	/* Select the texture based on the map value */
-	texture = state->wallTextures[MAP[xy2index(mapBox.x, mapBox.y, MAP_SIZE)]];
+	asset = state->wallTiles[map_tile(map, hit->mapBox.x, hit->mapBox.y)];
+	texture = asset->texture;
 
 	/* Calculate texture coordinates */
-	float wallX = (side == EastWest) ? player->pos.y +
-		perpWallDist * rayDir.y : player->pos.x + perpWallDist * rayDir.x;
-	wallX -= floor(wallX);
-	srcRect.x = (int)(wallX * 512); /* Width of your texture */
+	srcRect.x = MIN((int)(hit->wallX * asset->texels.w),
+		asset->texels.w - 1);
 	srcRect.y = 0;
 	srcRect.w = 1;
-	srcRect.h = 512; /* Height of your texture */
+	srcRect.h = asset->texels.h;
 
 	dstRect.x = x;
 	dstRect.y = drawStart;
 	dstRect.w = 1;
 	dstRect.h = drawEnd - drawStart;
 
-	/* Set the texture color based on the side */
-	if (side == NorthSouth)
-		SDL_SetTextureColorMod(texture, 128, 128, 128);
-	else
-		SDL_SetTextureColorMod(texture, 255, 255, 255);
+	/* Full white through the colormap is the scale of every channel */
+	light = state->colormap[wall_light(hit)][255];
+	SDL_SetTextureColorMod(texture, light, light, light);
 
 	SDL_RenderCopy(state->renderer, texture, &srcRect, &dstRect);
+	profile_draw(state, texture);
+}
+
+/**
+ * same_face - Checks whether two columns hit the same face of a wall.
+ * @a: The hit of the first column.
+ * @b: The hit of the second column.
+ * Return: true if both hit the same side of the same cell.
+ */
+static bool same_face(const ColumnHit *a, const ColumnHit *b)
+{
+	return (a->mapBox.x == b->mapBox.x && a->mapBox.y == b->mapBox.y &&
+		a->side == b->side);
+}
+
+/**
+ * span_fits - Checks whether a range of columns is drawn well by one quad.
+ * @hits: The hits of every column.
+ * @x0: The first column of the range.
+ * @x1: The column just after the range, on the same face.
+ * @texW: The width of the wall texture in texels.
+ * @texH: The height of the wall texture in texels.
+ * @height: The height of the view in pixels.
+ * Description: The wall height is linear in screen x, so the quad's edges
+ * are exact, but the texture coordinates are not. u follows the
+ * perspective; its error is largest near the middle of the range, so only
+ * the middle column is checked against one texel. v is interpolated over
+ * each of the quad's two triangles separately, which bends it along the
+ * diagonal by up to the relative height change times the texture height;
+ * that must stay under one texel too.
+ * Return: true if the range can be one quad.
+ */
+static bool span_fits(const ColumnHit *hits, int x0, int x1, int texW,
+	int texH, int height)
+{
+	int mid = (x0 + x1) / 2;
+	float t = (float)(mid - x0) / (x1 - x0);
+	float u = hits[x0].wallX + (hits[x1].wallX - hits[x0].wallX) * t;
+	float h0 = height / hits[x0].distance, h1 = height / hits[x1].distance;
+
+	return (fabsf(u - hits[mid].wallX) * texW < 1.0f &&
+		fabsf(h1 - h0) / fminf(h0, h1) * texH < 1.0f);
+}
+
+/**
+ * build_wall_spans - Groups the columns of the frame into wall spans.
+ * @state: Pointer to the State holding this frame's hits.
+ * @map: the map which is used during the game.
+ * Return: The number of spans written to state->wallSpans.
+ * Description: A span only covers columns hitting the same face and grows
+ * until span_fits() fails. Its right edge takes the values of the first
+ * column of the next span on the same face, so neighbouring quads share
+ * their edge exactly. The last column of a face has no such neighbour and
+ * becomes a span of its own.
+ */
+static int build_wall_spans(State *state, const Map *map)
+{
+	const ColumnHit *hits = state->columnHits;
+	int count = 0, width = state->viewW, height = state->viewH;
+
+	for (int x0 = 0, x1; x0 < width; x0 = x1)
+	{
+		const Asset *asset = state->wallTiles[map_tile(map,
+			hits[x0].mapBox.x, hits[x0].mapBox.y)];
+		WallSpan *span = &state->wallSpans[count++];
+
+		x1 = x0 + 1;
+		while (x1 + 1 < width && same_face(&hits[x0], &hits[x1]) &&
+			same_face(&hits[x0], &hits[x1 + 1]) &&
+			span_fits(hits, x0, x1 + 1, asset->texels.w,
+				asset->texels.h, height))
+			x1++;
+		span->x0 = x0;
+		span->x1 = x1;
+		span->u0 = hits[x0].wallX;
+		span->h0 = height / hits[x0].distance;
+		span->light0 = state->colormap[wall_light(&hits[x0])][255];
+		span->light1 = state->colormap[wall_light(&hits[x1 - 1])][255];
+		span->texture = asset->texture;
+		if (x1 < width && same_face(&hits[x0], &hits[x1]))
+		{
+			span->u1 = hits[x1].wallX;
+			span->h1 = height / hits[x1].distance;
+			span->light1 = state->colormap[wall_light(&hits[x1])][255];
+		}
+		else
+		{
+			/* A lone column shows one texel, like render_column() */
+			span->u1 = span->u0 + 1.0f / asset->texels.w;
+			span->h1 = span->h0;
+		}
+		span->u1 = fminf(fmaxf(span->u1, 0.0f), 1.0f);
+	}
+	return (count);
+}
+
+/**
+ * emit_span - Appends the quad of a wall span to the vertex buffers.
+ * @span: The span.
+ * @vertices: Where its 4 vertices are written.
+ * @indices: Where its 6 indices are written.
+ * @base: Index of the first of the 4 vertices in the batch.
+ * @height: The height of the view in pixels.
+ */
+static void emit_span(const WallSpan *span, SDL_Vertex *vertices, int *indices,
+	int base, int height)
+{
+	SDL_Color left = {span->light0, span->light0, span->light0, 0xFF};
+	SDL_Color right = {span->light1, span->light1, span->light1, 0xFF};
+
+	vertices[0] = (SDL_Vertex) {{span->x0, (height - span->h0) / 2},
+		left, {span->u0, 0.0f}};
+	vertices[1] = (SDL_Vertex) {{span->x1, (height - span->h1) / 2},
+		right, {span->u1, 0.0f}};
+	vertices[2] = (SDL_Vertex) {{span->x1, (height + span->h1) / 2},
+		right, {span->u1, 1.0f}};
+	vertices[3] = (SDL_Vertex) {{span->x0, (height + span->h0) / 2},
+		left, {span->u0, 1.0f}};
+	indices[0] = base;
+	indices[1] = base + 1;
+	indices[2] = base + 2;
+	indices[3] = base;
+	indices[4] = base + 2;
+	indices[5] = base + 3;
+}
+
+/**
+ * render_walls - Draws the walls of the frame in a few batched calls.
+ * @state: Pointer to the State holding this frame's hits.
+ * @map: the map which is used during the game.
+ * Description: Columns are grouped into spans along each wall face, each
+ * span becomes one textured quad lit through its vertex colors, and
+ * all the quads sharing a texture are submitted with one
+ * SDL_RenderGeometry call. When a call fails, the columns of its texture
+ * are drawn one at a time with render_column() instead.
+ */
+void render_walls(State *state, const Map *map)
+{
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+	int count = build_wall_spans(state, map);
+
+	for (int first = 0; first < count; first++)
+	{
+		SDL_Texture *texture = state->wallSpans[first].texture;
+		int quads = 0;
+		bool drawn;
+
+		if (!texture)
+			continue;
+		for (int i = first; i < count; i++)
+		{
+			if (state->wallSpans[i].texture != texture)
+				continue;
+			emit_span(&state->wallSpans[i], &state->wallVertices[quads * 4],
+				&state->wallIndices[quads * 6], quads * 4, state->viewH);
+			quads++;
+		}
+		drawn = SDL_RenderGeometry(state->renderer, texture,
+			state->wallVertices, quads * 4, state->wallIndices, quads * 6) == 0;
+		profile_draw(state, texture);
+		for (int i = first; i < count; i++)
+		{
+			WallSpan *span = &state->wallSpans[i];
+
+			if (span->texture != texture)
+				continue;
+			span->texture = NULL;
+			for (int x = span->x0; !drawn && x < span->x1; x++)
+				render_column(state, x, &state->columnHits[x], map);
+		}
+	}
+	return;
+#endif
+	for (int x = 0; x < state->viewW; ++x)
+		render_column(state, x, &state->columnHits[x], map);
+}
+
+/**
+ * render_scene - Brings the cached 3D view up to date.
+ * @state: Pointer to the State holding the scene texture.
+ * @player: Pointer to the Player structure the view is rendered from.
+ * @map: the map which is used during the game.
+ * Return: true if the scene was rendered again, false if the cached one is
+ * still what render() or render_software() would draw.
+ * Description: The scene is rendered into state->sceneTexture, to be
+ * composited with the HUD every time the frame is presented. It is only
+ * redrawn when the player pose, the map, the map view, the view scale or a
+ * texture that finished loading changed, or when the enemies would be drawn
+ * differently. For the latter they are projected against the cached wall
+ * hits, which are still this view's, and compared by state->spriteHash, so
+ * enemies moving out of sight do not cost a redraw. Only the top-left
+ * state->viewW x state->viewH pixels of the texture are drawn; they are
+ * stretched over the window when it is composited. Without a scene texture
+ * it is drawn straight to the window on every call.
+ */
+bool render_scene(State *state, Player *player, const Map *map)
+{
+	SceneKey key;
+
+	memset(&key, 0, sizeof(key));
+	key.view = *player;
+	key.mapRevision = map->revision;
+	key.sprites = state->sceneKey.sprites;
+	key.mapView = state->mapViewEnabled;
+	key.assets = state->assets.revision;
+	key.scale = state->scaler.scale;
+	if (state->sceneTexture && state->sceneValid &&
+		memcmp(&key, &state->sceneKey, sizeof(key)) == 0)
+	{
+		project_enemies(state, player);
+		if (state->spriteHash == key.sprites)
+			return (false);
+	}
+
+	if (state->sceneTexture)
+		SDL_SetRenderTarget(state->renderer, state->sceneTexture);
+	SDL_SetRenderDrawColor(state->renderer, 0x18, 0x18, 0x18, 0xFF);
+	SDL_RenderClear(state->renderer);
+	if (state->renderMode == RenderSoftware)
+		render_software(state, player, map);
+	else
+		render(state, player, map);
+	if (state->sceneTexture)
+		SDL_SetRenderTarget(state->renderer, NULL);
+	key.sprites = state->spriteHash;
+	state->sceneKey = key;
+	state->sceneValid = true;
+	return (true);
 }
 
 /**
  * render - Renders the entire scene.
  * @state: Pointer to the State structure containing the SDL renderer.
  * @player: Pointer to the Player structure containing player information.
- * @MAP: the map which is used during the game.
+ * @map: the map which is used during the game.
  * Return: None
  */
-void render(State *state, Player *player, uint8_t MAP[MAP_SIZE * MAP_SIZE])
+void render(State *state, Player *player, const Map *map)
 {
-	SDL_Rect ceilingRect = {0, 0, SCREEN_W, SCREEN_H / 2};
-	SDL_Rect groundRect = {0, SCREEN_H / 2, SCREEN_W, SCREEN_H / 2};
-
-	/* Set color for the ceiling and fill the ceiling area */
-	SDL_SetRenderDrawColor(state->renderer, RGBA_Ceiling.r,
-		RGBA_Ceiling.g, RGBA_Ceiling.b, RGBA_Ceiling.a);
-	SDL_RenderFillRect(state->renderer, &ceilingRect);
+	SDL_Rect view = {0, 0, state->viewW, state->viewH};
+	void *pixels;
+	int pitch;
+	Uint64 start = profile_begin(state);
 
-	/* Set color for the ground and fill the ground area */
-	SDL_SetRenderDrawColor(state->renderer, RGBA_Ground.r,
-		RGBA_Ground.g, RGBA_Ground.b, RGBA_Ground.a);
-	SDL_RenderFillRect(state->renderer, &groundRect);
-	for (int x = 0; x < SCREEN_W; ++x)
+	/* Floor and ceiling are cast row by row and uploaded as one texture */
+	if (SDL_LockTexture(state->frameTexture, &view, &pixels, &pitch) == 0)
 	{
-		Vec2F rayDir = calculate_ray_direction(player, x);
-		Vec2I mapBox;
-		Vec2F sideDist = {0.0f, 0.0f};
-		Vec2F deltaDist;
-		Vec2I stepDir;
-		Side side;
-
-		initialize_raycasting(player, rayDir,
-			&mapBox, &sideDist, &deltaDist, &stepDir);
-		perform_dda(&mapBox, &sideDist, &deltaDist, &stepDir, &side, MAP);
-
-		float perpWallDist = calculate_wall_distance(side, &sideDist, &deltaDist);
-		int lineHeight = (int)(SCREEN_H / perpWallDist);
-
-		render_column(state, x, lineHeight, side,
-			mapBox, MAP, perpWallDist, rayDir, player);
-		/*render_ground(state, x, lineHeight, mapBox, MAP, perpWallDist, player);*/
+		render_floor_ceiling(state, player, map, pixels, pitch);
+		SDL_UnlockTexture(state->frameTexture);
+		SDL_RenderCopy(state->renderer, state->frameTexture, &view, &view);
+		profile_draw(state, state->frameTexture);
 	}
-	/*render_enemies(state, player);*/
+	profile_end(state, StageFloor, start);
+	start = profile_begin(state);
+	cast_columns(state, player, map);
+	profile_end(state, StageRaycast, start);
+	start = profile_begin(state);
+	render_walls(state, map);
+	profile_end(state, StageWalls, start);
+	start = profile_begin(state);
+	render_enemies(state, player);
+	profile_end(state, StageSprites, start);
 	if (state->mapViewEnabled)
 	{
-		draw_map(state, MAP);
+		start = profile_begin(state);
+		update_minimap(state, map, player->pos);
+		/* The map is laid out in window pixels */
+		SDL_RenderSetScale(state->renderer, (float)state->viewW / SCREEN_W,
+			(float)state->viewH / SCREEN_H);
+		draw_map(state, map);
 		draw_player(state, player);
+		SDL_RenderSetScale(state->renderer, 1.0f, 1.0f);
+		profile_end(state, StageMap, start);
 	}
 }
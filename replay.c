@@ -0,0 +1,357 @@
+#include "structure.h"
+
+/* The keys the simulation reads, one bit each in a recorded step */
+static const SDL_Scancode recordedKeys[] = {
+	SDL_SCANCODE_ESCAPE, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT,
+	SDL_SCANCODE_W, SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D
+};
+#define NUM_RECORDED_KEYS (int)(sizeof(recordedKeys) / sizeof(*recordedKeys))
+
+/**
+ * open_recording - Creates a recording and writes a provisional header.
+ * @state: The game state, whose map, page budget and enemy count are
+ * recorded.
+ * Return: true on success, false otherwise.
+ * Description: The frame count and final hash are only known on exit, when
+ * finish_replay() writes the header again.
+ */
+static bool open_recording(State *state)
+{
+	Replay *replay = &state->replay;
+	ReplayHeader *header = &replay->header;
+
+	if (strlen(state->mapPath) >= sizeof(header->mapPath))
+	{
+		printf("Map path too long to record: %s\n", state->mapPath);
+		return (false);
+	}
+	replay->file = fopen(replay->path, "wb");
+	if (!replay->file)
+	{
+		printf("Failed to open %s for writing\n", replay->path);
+		return (false);
+	}
+	memcpy(header->magic, REPLAY_MAGIC, sizeof(header->magic));
+	header->version = REPLAY_VERSION;
+	header->initialEnemies = state->initialEnemies;
+	header->pageBudget = state->pageBudget;
+	strcpy(header->mapPath, state->mapPath);
+	replay->failed = fwrite(header, sizeof(*header), 1, replay->file) != 1;
+	return (true);
+}
+
+/**
+ * open_playback - Opens a recording and sets the run up the way it was.
+ * @state: The game state.
+ * Return: true on success, false if the file is not a usable recording.
+ */
+static bool open_playback(State *state)
+{
+	Replay *replay = &state->replay;
+	ReplayHeader *header = &replay->header;
+
+	replay->file = fopen(replay->path, "rb");
+	if (!replay->file)
+	{
+		printf("Failed to open recording: %s\n", replay->path);
+		return (false);
+	}
+	if (fread(header, sizeof(*header), 1, replay->file) != 1 ||
+		memcmp(header->magic, REPLAY_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != REPLAY_VERSION ||
+		!memchr(header->mapPath, '\0', sizeof(header->mapPath)))
+	{
+		printf("Not a recording or unsupported version: %s\n", replay->path);
+		fclose(replay->file);
+		replay->file = NULL;
+		return (false);
+	}
+	state->mapPath = header->mapPath;
+	state->initialEnemies = header->initialEnemies;
+	state->pageBudget = header->pageBudget;
+	/* Run unthrottled, at a fixed resolution, so builds can be compared */
+	state->vsync = false;
+	state->scaler.budgetMs = 0.0f;
+	return (true);
+}
+
+/**
+ * start_replay - Opens the recording of the run, if there is one.
+ * @state: The game state, configured by parse_args().
+ * Return: false if the recording cannot be opened.
+ * Description: Called before the map is loaded: a replay loads the map,
+ * with the page budget, and scatters the enemies the recorded run did,
+ * whatever the options say.
+ */
+bool start_replay(State *state)
+{
+	if (state->replay.mode == ReplayRecord)
+		return (open_recording(state));
+	if (state->replay.mode == ReplayPlay)
+		return (open_playback(state));
+	return (true);
+}
+
+/**
+ * read_replay_frame - Reads the next recorded frame.
+ * @replay: The replay.
+ * @steps: Where the number of simulation steps to run is stored.
+ * @alpha: Where the interpolation factor to render at is stored.
+ * @mapView: Where whether the map view is shown is stored.
+ * Return: false once the recording is over.
+ */
+bool read_replay_frame(Replay *replay, int *steps, float *alpha,
+	bool *mapView)
+{
+	ReplayFrame *frame = &replay->frame;
+
+	if (fread(frame, sizeof(*frame), 1, replay->file) != 1)
+	{
+		replay->failed = !feof(replay->file);
+		return (false);
+	}
+	if (frame->steps > SIM_MAX_STEPS ||
+		fread(replay->ticks, 1, frame->steps, replay->file) != frame->steps)
+	{
+		printf("Truncated or corrupt recording: %s\n", replay->path);
+		replay->failed = true;
+		return (false);
+	}
+	replay->tick = 0;
+	*steps = frame->steps;
+	*alpha = frame->alpha / 65535.0f;
+	*mapView = frame->flags & REPLAY_MAP_VIEW;
+	return (true);
+}
+
+/**
+ * replay_keys - Gets the keyboard state one simulation step reads.
+ * @replay: The replay.
+ * Return: The live keyboard state, or the recorded one while replaying.
+ * Description: Called once per step. While recording, the keys the
+ * simulation reads are noted for write_replay_frame().
+ */
+const uint8_t *replay_keys(Replay *replay)
+{
+	const uint8_t *keystate = SDL_GetKeyboardState(NULL);
+	uint8_t bits = 0;
+
+	if (replay->mode == ReplayOff || replay->tick >= SIM_MAX_STEPS)
+		return (keystate);
+	if (replay->mode == ReplayRecord)
+	{
+		for (int i = 0; i < NUM_RECORDED_KEYS; i++)
+			bits |= (keystate[recordedKeys[i]] != 0) << i;
+		replay->ticks[replay->tick++] = bits;
+		return (keystate);
+	}
+	bits = replay->ticks[replay->tick++];
+	for (int i = 0; i < NUM_RECORDED_KEYS; i++)
+		replay->keys[recordedKeys[i]] = bits >> i & 1;
+	return (replay->keys);
+}
+
+/**
+ * write_replay_frame - Appends the frame just simulated to the recording.
+ * @replay: The replay.
+ * @alpha: How far between the last two steps the frame is rendered.
+ * @mapView: Whether the map view is shown.
+ * Description: Records the steps replay_keys() noted since the last call.
+ */
+void write_replay_frame(Replay *replay, float alpha, bool mapView)
+{
+	ReplayFrame frame = {.steps = replay->tick,
+		.flags = mapView ? REPLAY_MAP_VIEW : 0,
+		.alpha = (uint16_t)(MIN(MAX(alpha, 0.0f), 1.0f) * 65535.0f + 0.5f)};
+
+	replay->failed |= fwrite(&frame, sizeof(frame), 1, replay->file) != 1 ||
+		fwrite(replay->ticks, 1, replay->tick, replay->file) !=
+		(size_t)replay->tick;
+	replay->header.frames++;
+	replay->header.steps += replay->tick;
+	replay->tick = 0;
+}
+
+/**
+ * time_replay_frame - Notes how long a replayed frame took.
+ * @replay: The replay.
+ * @frameMs: The whole frame.
+ * @renderMs: Rendering it, negative if it showed the cached view.
+ */
+void time_replay_frame(Replay *replay, float frameMs, float renderMs)
+{
+	if (replay->count == replay->capacity)
+	{
+		int capacity = replay->capacity ? replay->capacity * 2 : 1024;
+		ReplayTiming *timings = realloc(replay->timings,
+			sizeof(ReplayTiming) * capacity);
+
+		ASSERT(timings, "Out of memory for %d frame timings\n", capacity);
+		replay->timings = timings;
+		replay->capacity = capacity;
+	}
+	replay->timings[replay->count++] = (ReplayTiming) {frameMs, renderMs,
+		replay->frame.steps};
+}
+
+/**
+ * hash_game_state - Hashes everything the simulation has changed.
+ * @state: The game state.
+ * @player: The simulated player.
+ * Return: A 64-bit FNV-1a hash of the step count, the player, the spawn
+ * timer and generator and every enemy, bit for bit.
+ */
+uint64_t hash_game_state(const State *state, const Player *player)
+{
+	const EntityPool *enemies = &state->enemies;
+	size_t count = enemies->count;
+	uint64_t hash = HASH_INIT;
+
+	hash = hash_bytes(hash, &state->simSteps, sizeof(state->simSteps));
+	hash = hash_bytes(hash, &player->pos, sizeof(player->pos));
+	hash = hash_bytes(hash, &player->dir, sizeof(player->dir));
+	hash = hash_bytes(hash, &player->plane, sizeof(player->plane));
+	hash = hash_bytes(hash, &state->enemySpawnTimer,
+		sizeof(state->enemySpawnTimer));
+	hash = hash_bytes(hash, &enemies->rng, sizeof(enemies->rng));
+	hash = hash_bytes(hash, &enemies->count, sizeof(enemies->count));
+	if (count == 0)
+		return (hash);
+	hash = hash_bytes(hash, enemies->posX, sizeof(float) * count);
+	hash = hash_bytes(hash, enemies->posY, sizeof(float) * count);
+	hash = hash_bytes(hash, enemies->velX, sizeof(float) * count);
+	hash = hash_bytes(hash, enemies->velY, sizeof(float) * count);
+	return (hash_bytes(hash, enemies->type, count));
+}
+
+/**
+ * compare_floats - Orders floats for qsort().
+ * @a: The first float.
+ * @b: The second float.
+ * Return: Negative, zero or positive as @a is below, equal to or above @b.
+ */
+static int compare_floats(const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+
+	return ((fa > fb) - (fa < fb));
+}
+
+/**
+ * print_percentiles - Prints the p50, p99 and maximum of a set of times.
+ * @label: What the times are.
+ * @times: The times in ms; sorted in place.
+ * @count: The number of times.
+ */
+static void print_percentiles(const char *label, float *times, int count)
+{
+	if (count == 0)
+		return;
+	qsort(times, count, sizeof(float), compare_floats);
+	printf("%s ms: p50 %.3f p99 %.3f max %.3f\n", label,
+		times[count / 2], times[MIN(count * 99 / 100, count - 1)],
+		times[count - 1]);
+}
+
+/**
+ * write_timings - Writes the timing of every replayed frame as CSV.
+ * @replay: The replay.
+ * Return: true if the whole file was written.
+ */
+static bool write_timings(const Replay *replay)
+{
+	FILE *file = fopen(replay->timingsPath, "w");
+	bool ok;
+
+	if (!file)
+	{
+		printf("Failed to open %s for writing\n", replay->timingsPath);
+		return (false);
+	}
+	fprintf(file, "frame,steps,frame_ms,render_ms\n");
+	for (int i = 0; i < replay->count; i++)
+		fprintf(file, "%d,%d,%.4f,%.4f\n", i, replay->timings[i].steps,
+			replay->timings[i].frameMs, replay->timings[i].renderMs);
+	ok = !ferror(file);
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		printf("Failed to write %s\n", replay->timingsPath);
+	return (ok);
+}
+
+/**
+ * report_playback - Prints the frame times and the outcome of a replay.
+ * @replay: The replay.
+ * @hash: hash_game_state() at the end of the replay.
+ * Return: true if the replay ended in the recorded state.
+ */
+static bool report_playback(Replay *replay, uint64_t hash)
+{
+	float *frames = malloc(sizeof(float) * (replay->count + 1));
+	float *renders = malloc(sizeof(float) * (replay->count + 1));
+	int rendered = 0;
+	bool ok = hash == replay->header.finalHash && !replay->failed;
+
+	ASSERT(frames && renders, "Out of memory for the replay report\n");
+	for (int i = 0; i < replay->count; i++)
+	{
+		frames[i] = replay->timings[i].frameMs;
+		if (replay->timings[i].renderMs >= 0.0f)
+			renders[rendered++] = replay->timings[i].renderMs;
+	}
+	printf("replay %s: %d frames (%d rendered) of %llu recorded\n",
+		replay->path, replay->count, rendered,
+		(unsigned long long)replay->header.frames);
+	print_percentiles("frame", frames, replay->count);
+	print_percentiles("render", renders, rendered);
+	printf("state hash %016llx, recorded %016llx: %s\n",
+		(unsigned long long)hash,
+		(unsigned long long)replay->header.finalHash,
+		ok ? "match" : "MISMATCH");
+	free(frames);
+	free(renders);
+	if (replay->timingsPath && !write_timings(replay))
+		return (false);
+	return (ok);
+}
+
+/**
+ * finish_replay - Closes the recording of the run.
+ * @replay: The replay.
+ * @hash: hash_game_state() at the end of the run.
+ * Return: false if the recording could not be written, or if a replay did
+ * not end in the state the recorded run ended in.
+ * Description: A recording gets its final header. A replay prints its
+ * frame time percentiles and whether the hashes match, and writes the
+ * timing of every frame if asked to.
+ */
+bool finish_replay(Replay *replay, uint64_t hash)
+{
+	bool ok = true;
+
+	if (replay->mode == ReplayOff)
+		return (true);
+	if (replay->mode == ReplayRecord)
+	{
+		replay->header.finalHash = hash;
+		ok = !replay->failed && fseek(replay->file, 0, SEEK_SET) == 0 &&
+			fwrite(&replay->header, sizeof(replay->header), 1,
+				replay->file) == 1;
+		ok = fclose(replay->file) == 0 && ok;
+		if (ok)
+			printf("recorded %llu frames to %s, state hash %016llx\n",
+				(unsigned long long)replay->header.frames, replay->path,
+				(unsigned long long)hash);
+		else
+			printf("Failed to write %s\n", replay->path);
+	}
+	else
+	{
+		ok = report_playback(replay, hash);
+		fclose(replay->file);
+	}
+	free(replay->timings);
+	replay->file = NULL;
+	replay->timings = NULL;
+	return (ok);
+}
@@ -11,6 +11,7 @@
 #include <SDL2/SDL_scancode.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <math.h>
 #include <string.h>
@@ -30,12 +31,47 @@
 #define SCREEN_W 1280
 #define SCREEN_H 720
 
-#define MAP_SIZE 16
+/*
+ * The 3D view is rendered at VIEW_SCALE_UNIT-ths of the window size, from
+ * half the window up to twice it, and scaled to the window when presented
+ */
+#define VIEW_SCALE_UNIT 8
+#define VIEW_SCALE_MIN 4
+#define VIEW_SCALE_MAX 16
+#define VIEW_MAX_W (SCREEN_W * VIEW_SCALE_MAX / VIEW_SCALE_UNIT)
+#define VIEW_MAX_H (SCREEN_H * VIEW_SCALE_MAX / VIEW_SCALE_UNIT)
+/* Default time in ms rendering a frame may take before the view shrinks */
+#define FRAME_BUDGET_MS 8.3f
+/* Rendered frames timed at a view scale before it may change again */
+#define VIEW_SETTLE_FRAMES 16
+
+/* Maps are stored in square chunks of MAP_CHUNK_SIZE x MAP_CHUNK_SIZE tiles */
+#define MAP_CHUNK_SHIFT 5
+#define MAP_CHUNK_SIZE (1 << MAP_CHUNK_SHIFT)
+#define MAP_CHUNK_MASK (MAP_CHUNK_SIZE - 1)
+/* Tile reported for cells outside the map, so rays always terminate */
+#define MAP_SOLID 1
+/* Bits of Map.tileFlags */
+#define TILE_SOLID 0x01
+/* Start and version of binary map files */
+#define MAP_MAGIC "RCMAP\x1a\n"
+#define MAP_VERSION 2
+
+/* The game is simulated in fixed steps of SIM_DT seconds, whatever the FPS */
+#define SIM_HZ 120
+#define SIM_DT (1.0f / SIM_HZ)
+/* Simulated time a single frame may catch up on before the game slows down */
+#define SIM_MAX_STEPS 12
+/* Player speeds, in cells and radians per second */
+#define MOVE_SPEED 3.0f
+#define ROTATE_SPEED 1.5f
 
 #define PI 3.14159265f
 #define playerFOV (PI / 2.0f)
 #define maxDepth 20.0f
 #define MAX_TEXTURES 10
+/* Starting value of hash_bytes() hashes, the FNV-1a offset basis */
+#define HASH_INIT 0xCBF29CE484222325ull
 
 /**
  * enum Side - Represents possible directions in a 2D plane
@@ -47,6 +83,16 @@ typedef enum Side
 	NorthSouth, EastWest
 } Side;
 
+/**
+ * enum RenderMode - Selects the path used to draw the 3D view
+ * @RenderSDL: One SDL_RenderCopy per screen column
+ * @RenderSoftware: Raycast into a CPU framebuffer uploaded once per frame
+ */
+typedef enum RenderMode
+{
+	RenderSDL, RenderSoftware
+} RenderMode;
+
 /**
  * struct Vec2F - Represents a 2D vector with floating-point coordinates
  * @x: The x-coordinate of the vector
@@ -81,6 +127,152 @@ typedef struct Player
 	Vec2F plane;
 } Player;
 
+typedef struct MapPager MapPager;
+
+/**
+ * struct Map - A level grid whose size is only known at runtime
+ * @width: Number of tiles along x
+ * @height: Number of tiles along y
+ * @chunksX: Number of chunks per row of chunks
+ * @tiles: The tiles, chunk by chunk, when the whole map is in memory; each
+ * chunk holds its MAP_CHUNK_SIZE rows contiguously so nearby cells share
+ * cache lines in both directions. NULL for paged maps
+ * @chunks: One pointer per chunk to its tiles, row of chunks by row of
+ * chunks; NULL for chunks of a paged map that are not resident
+ * @pager: Streams regions of the map from disk, or NULL when the whole map
+ * is in memory
+ * @tileFlags: TILE_* flags of each of the 256 tile values
+ * @playerSpawn: Where the player starts
+ * @enemySpawns: Where enemies spawn, in turn
+ * @numEnemySpawns: Number of entries in @enemySpawns, 0 for the default
+ * @mapping: The mapped file @tiles and @enemySpawns point into, or NULL
+ * when they were allocated
+ * @mappingSize: Size of @mapping in bytes
+ * @distance: Chebyshev distance in cells from each cell to the nearest
+ * solid cell (cells outside the map count as solid), capped at 255, row by
+ * row; 0 exactly for solid cells. Points into @mapping when it was baked
+ * into a binary map; NULL when there is none, as for paged maps
+ * @revision: Bumped whenever tiles change or chunks are paged in or out, so
+ * cached renders of the map can tell they are stale
+ */
+typedef struct Map
+{
+	int width, height;
+	int chunksX;
+	uint8_t *tiles;
+	uint8_t **chunks;
+	MapPager *pager;
+	uint8_t tileFlags[256];
+	Vec2F playerSpawn;
+	Vec2F *enemySpawns;
+	int numEnemySpawns;
+	void *mapping;
+	size_t mappingSize;
+	uint8_t *distance;
+	Uint32 revision;
+} Map;
+
+/**
+ * struct MapFileHeader - Start of a binary map file, in native byte order
+ * @magic: MAP_MAGIC, including its terminating NUL
+ * @version: MAP_VERSION
+ * @width: Number of tiles along x
+ * @height: Number of tiles along y
+ * @chunkShift: MAP_CHUNK_SHIFT of the writer; the tiles are stored in the
+ * chunked layout of Map.tiles, so it must match the reader's
+ * @numEnemySpawns: Number of Vec2F enemy spawns following the header
+ * @tilesOffset: Offset of the tile array from the start of the file
+ * @tilesSize: Size of the tile array in bytes, padding chunks included
+ * @distanceOffset: Offset of Map.distance, width * height bytes following
+ * the tiles, or 0 if the file has no distance field
+ * @playerSpawn: Where the player starts
+ * @tileFlags: TILE_* flags of each of the 256 tile values
+ */
+typedef struct MapFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t chunkShift;
+	uint32_t numEnemySpawns;
+	uint32_t tilesOffset;
+	uint64_t tilesSize;
+	uint64_t distanceOffset;
+	Vec2F playerSpawn;
+	uint8_t tileFlags[256];
+} MapFileHeader;
+
+/**
+ * hash_bytes - Folds bytes into an FNV-1a hash.
+ * @hash: The hash so far, HASH_INIT for a new one.
+ * @data: The bytes.
+ * @size: The number of bytes.
+ * Return: The new hash.
+ */
+static inline uint64_t hash_bytes(uint64_t hash, const void *data,
+	size_t size)
+{
+	const uint8_t *bytes = data;
+
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+	return (hash);
+}
+
+/**
+ * map_tile - Reads the tile of a cell.
+ * @map: The map.
+ * @x: The x-coordinate of the cell.
+ * @y: The y-coordinate of the cell.
+ * Return: The tile, or MAP_SOLID for cells outside the map or in chunks
+ * that are not resident, so rays stop there instead of waiting for disk.
+ */
+static inline uint8_t map_tile(const Map *map, int x, int y)
+{
+	const uint8_t *chunk;
+
+	if ((unsigned int)x >= (unsigned int)map->width ||
+		(unsigned int)y >= (unsigned int)map->height)
+		return (MAP_SOLID);
+	chunk = map->chunks[(y >> MAP_CHUNK_SHIFT) * map->chunksX +
+		(x >> MAP_CHUNK_SHIFT)];
+	if (!chunk)
+		return (MAP_SOLID);
+	return (chunk[(y & MAP_CHUNK_MASK) << MAP_CHUNK_SHIFT |
+		(x & MAP_CHUNK_MASK)]);
+}
+
+/**
+ * map_solid - Tells whether a cell stops rays and movement.
+ * @map: The map.
+ * @x: The x-coordinate of the cell.
+ * @y: The y-coordinate of the cell.
+ * Return: true if the cell's tile has TILE_SOLID set. Cells outside the map
+ * or not resident read as MAP_SOLID, which every map must flag as solid.
+ */
+static inline bool map_solid(const Map *map, int x, int y)
+{
+	return (map->tileFlags[map_tile(map, x, y)] & TILE_SOLID);
+}
+
+/**
+ * map_distance - Reads the distance field of a cell.
+ * @map: The map, with map->distance built.
+ * @x: The x-coordinate of the cell.
+ * @y: The y-coordinate of the cell.
+ * Return: How many cells away the nearest solid cell is at least, so every
+ * cell within one less than that in both x and y is empty; 0 for solid
+ * cells and cells outside the map.
+ */
+static inline uint8_t map_distance(const Map *map, int x, int y)
+{
+	if ((unsigned int)x >= (unsigned int)map->width ||
+		(unsigned int)y >= (unsigned int)map->height)
+		return (0);
+	return (map->distance[(size_t)y * map->width + x]);
+}
+
 /**
  * struct ColorRGBA - Represents a color with red, green, blue, and alpha
  * @r: The red channel of the color (0-255)
@@ -94,15 +286,674 @@ typedef struct ColorRGBA
 } ColorRGBA;
 
 /**
- * struct Enemy - Represents an enemy in the game.
- * @pos: The position of the enemy.
- * @texture: The texture of the enemy.
+ * struct Texels - Decoded texture kept in memory for software rendering
+ * @w: Width of the texture in pixels
+ * @h: Height of the texture in pixels
+ * @pixels: ARGB8888 pixels, row-major, w * h entries
  */
-typedef struct Enemy
+typedef struct Texels
+{
+	int w, h;
+	uint32_t *pixels;
+} Texels;
+
+/* A 32768 texel side halves down to 1 in 15 steps */
+#define MAX_MIP_LEVELS 16
+
+/**
+ * struct ColumnMips - A texture transposed for drawing it column by column
+ * @levels: Number of levels; each one halves the size of the one before,
+ * down to 1x1
+ * @pow2: Whether the width and height of level 0 are powers of two, so
+ * every level can wrap coordinates with a mask
+ * @level: The levels, level 0 at full size; their pixels are column-major,
+ * texel (x, y) at pixels[x * h + y], and share level[0].pixels' allocation
+ */
+typedef struct ColumnMips
+{
+	int levels;
+	bool pow2;
+	Texels level[MAX_MIP_LEVELS];
+} ColumnMips;
+
+/**
+ * select_mip - Picks the mip level to draw a texture column with.
+ * @mips: The mip chain of the texture.
+ * @height: How many pixels tall the column is drawn on screen.
+ * Return: The smallest level still at least @height texels tall, so no
+ * texel is skipped and each pixel reads the next texel down the column.
+ */
+static inline const Texels *select_mip(const ColumnMips *mips, int height)
+{
+	int level = 0;
+
+	while (level + 1 < mips->levels && mips->level[level + 1].h >= height)
+		level++;
+	return (&mips->level[level]);
+}
+
+/* Light levels, from black (0) to full brightness (LIGHT_FULL) */
+#define LIGHT_LEVELS 32
+#define LIGHT_FULL (LIGHT_LEVELS - 1)
+
+/**
+ * Colormap - What each 8-bit color channel becomes at each light level
+ */
+typedef uint8_t Colormap[LIGHT_LEVELS][256];
+
+/**
+ * light_level - Dims a light level with distance.
+ * @light: The light level of the surface, LIGHT_FULL for now; a per-sector
+ * level would be passed here.
+ * @distance: The perpendicular distance to the surface.
+ * Return: @light lowered linearly with @distance, reaching black at maxDepth.
+ */
+static inline int light_level(int light, float distance)
+{
+	int fade = (int)(distance * LIGHT_LEVELS / maxDepth);
+
+	return (light > fade ? light - fade : 0);
+}
+
+/**
+ * shade_texel - Lights an ARGB8888 color through a colormap row.
+ * @shade: The row of the colormap for the light level.
+ * @color: The color; its alpha is kept.
+ * Return: The lit color.
+ */
+static inline uint32_t shade_texel(const uint8_t *shade, uint32_t color)
+{
+	return ((color & 0xFF000000) | shade[color >> 16 & 0xFF] << 16 |
+		shade[color >> 8 & 0xFF] << 8 | shade[color & 0xFF]);
+}
+
+typedef struct AssetJob AssetJob;
+
+/* Start and version of texture pack files, and where the game looks for one */
+#define TEXPACK_MAGIC "RCTEX\x1a\n"
+#define TEXPACK_VERSION 1
+#define TEXPACK_FILE "./texture/textures.rctex"
+/* Longest path, terminating NUL included, a texture pack can index */
+#define TEXPACK_PATH_MAX 128
+
+/**
+ * struct TexPackHeader - Start of a texture pack file, in native byte order
+ * @magic: TEXPACK_MAGIC, including its terminating NUL
+ * @version: TEXPACK_VERSION
+ * @count: Number of TexPackEntry following the header
+ */
+typedef struct TexPackHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t count;
+} TexPackHeader;
+
+/**
+ * struct TexPackEntry - One baked image of a texture pack
+ * @path: The path of the source image, without a leading "./"
+ * @sourceSize: Size of the source image when it was baked
+ * @sourceMtime: Modification time of the source image when it was baked;
+ * an entry whose source changed since is stale and not used
+ * @w: Width of the image in pixels
+ * @h: Height of the image in pixels
+ * @texelsOffset: Offset of the ARGB8888 row-major pixels from the start of
+ * the file
+ * @mipsOffset: Offset of the column-major mip chain, laid out as
+ * layout_column_mips() places it
+ */
+typedef struct TexPackEntry
+{
+	char path[TEXPACK_PATH_MAX];
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+	uint32_t w;
+	uint32_t h;
+	uint64_t texelsOffset;
+	uint64_t mipsOffset;
+} TexPackEntry;
+
+/**
+ * struct TexturePack - A texture pack mapped into memory
+ * @mapping: Start of the read-only mapping, NULL if no pack is open
+ * @size: Size of the mapping
+ * @entries: The index of the pack
+ * @count: Number of entries
+ */
+typedef struct TexturePack
+{
+	void *mapping;
+	size_t size;
+	const TexPackEntry *entries;
+	int count;
+} TexturePack;
+
+/**
+ * struct Asset - An image decoded once and shared by everything that uses it
+ * @path: The path the image was loaded from, the key of the registry
+ * @texels: CPU copy of the pixels, used by the software paths
+ * @columns: Column-major mip chain of the pixels, used to draw walls and
+ * sprites in software
+ * @texture: GPU copy of the pixels, used by the SDL paths
+ * @refCount: Number of handles to the asset still held
+ * @job: The decode still in flight for it, or NULL once it is loaded; until
+ * then @texels, @columns and @texture are the registry's placeholder
+ * @packed: Whether @texels and @columns point into the texture pack
+ */
+typedef struct Asset
+{
+	char *path;
+	Texels texels;
+	ColumnMips columns;
+	SDL_Texture *texture;
+	int refCount;
+	AssetJob *job;
+	bool packed;
+} Asset;
+
+/* Threads decoding images in the background */
+#define ASSET_LOADERS 2
+
+/**
+ * struct AssetRegistry - Every asset loaded by the game, keyed by path
+ * @assets: The loaded assets
+ * @count: The number of loaded assets
+ * @capacity: The number of slots allocated in @assets
+ * @renderer: The renderer GPU textures are created on
+ * @pack: Images baked ahead of time, used instead of decoding them
+ * @placeholder: Shown in place of every asset still being decoded
+ * @loaders: The threads decoding images
+ * @lock: Protects @queued, @queuedTail, @decoded and @quit
+ * @wake: Signalled when a job is queued or on shutdown
+ * @done: Signalled when a job is decoded
+ * @queued: Jobs waiting for a loader thread, oldest first
+ * @queuedTail: The last job of @queued
+ * @decoded: Jobs decoded and waiting for their GPU upload
+ * @quit: Set when the registry is being destroyed
+ * @pending: Number of assets still showing the placeholder; only touched by
+ * the main thread
+ * @revision: Bumped whenever an asset finishes loading, so cached renders
+ * showing its placeholder can tell they are stale
+ */
+typedef struct AssetRegistry
+{
+	Asset **assets;
+	int count;
+	int capacity;
+	SDL_Renderer *renderer;
+	TexturePack pack;
+	Asset placeholder;
+	SDL_Thread *loaders[ASSET_LOADERS];
+	SDL_mutex *lock;
+	SDL_cond *wake;
+	SDL_cond *done;
+	AssetJob *queued;
+	AssetJob *queuedTail;
+	AssetJob *decoded;
+	bool quit;
+	int pending;
+	Uint32 revision;
+} AssetRegistry;
+
+/**
+ * struct ColumnHit - Result of casting the ray of one screen column
+ * @distance: Perpendicular distance from the camera plane to the wall
+ * @side: The side of the wall that was hit
+ * @mapBox: The map cell of the wall that was hit
+ * @wallX: Where on the wall the ray hit, in the range [0, 1)
+ * @steps: Number of map cells the DDA looked up on the way
+ */
+typedef struct ColumnHit
+{
+	float distance;
+	Side side;
+	Vec2I mapBox;
+	float wallX;
+	int steps;
+} ColumnHit;
+
+/**
+ * struct RayQuery - A ray to trace through the map
+ * @origin: Where the ray starts, in map coordinates
+ * @dir: Direction of the ray, of any non-zero length
+ * @maxDistance: How far along the ray to look, in cells
+ */
+typedef struct RayQuery
+{
+	Vec2F origin;
+	Vec2F dir;
+	float maxDistance;
+} RayQuery;
+
+/**
+ * struct RayHit - Where a RayQuery first enters a solid cell
+ * @hit: Whether it does within its maxDistance; the other fields are only
+ * set when it does
+ * @cell: The solid cell
+ * @side: The kind of grid line crossed to enter it
+ * @distance: Distance from the origin along the ray, in cells
+ * @point: The point where the ray enters the cell
+ */
+typedef struct RayHit
+{
+	bool hit;
+	Vec2I cell;
+	Side side;
+	float distance;
+	Vec2F point;
+} RayHit;
+
+/**
+ * struct WallSpan - Adjacent columns drawn as one textured quad
+ * @x0: The first column of the span
+ * @x1: One past the last column of the span
+ * @u0: Texture coordinate at the left edge of the span
+ * @u1: Texture coordinate at the right edge of the span
+ * @h0: Height of the wall at the left edge of the span, in pixels
+ * @h1: Height of the wall at the right edge of the span, in pixels
+ * @light0: Colormap value of full white at the left edge, for shading
+ * @light1: Colormap value of full white at the right edge
+ * @texture: The texture of the wall
+ */
+typedef struct WallSpan
+{
+	int x0, x1;
+	float u0, u1;
+	float h0, h1;
+	Uint8 light0, light1;
+	SDL_Texture *texture;
+} WallSpan;
+
+/* Frames of history the profiler keeps, and scopes it records per frame */
+#define PROFILE_FRAMES 256
+#define PROFILE_EVENTS 64
+
+/**
+ * enum ProfileStage - The parts of a frame the profiler times
+ * @StageEvents: poll_events()
+ * @StageInput: handle_input(), summed over the simulation steps
+ * @StageMovement: update_player(), summed over the simulation steps
+ * @StageEnemies: handle_enemies(), summed over the simulation steps
+ * @StagePaging: update_map_paging()
+ * @StageAssets: poll_assets(), uploading a decoded image
+ * @StageFloor: Casting and uploading the floor and ceiling
+ * @StageRaycast: cast_columns()
+ * @StageWalls: Drawing the wall columns
+ * @StageSprites: Drawing the enemies
+ * @StageMap: Drawing the map view
+ * @StageWeapon: render_weapon()
+ * @StageOverlay: Drawing the profiler overlay
+ * @StagePresent: SDL_RenderPresent()
+ * @NumProfileStages: Number of stages
+ */
+typedef enum ProfileStage
+{
+	StageEvents, StageInput, StageMovement, StageEnemies, StagePaging,
+	StageAssets, StageFloor, StageRaycast, StageWalls, StageSprites, StageMap,
+	StageWeapon, StageOverlay, StagePresent, NumProfileStages
+} ProfileStage;
+
+/**
+ * enum ProfileCounter - Hot path events the profiler counts per frame
+ * @CounterRays: Rays cast
+ * @CounterDdaSteps: Map cells looked up by the DDA
+ * @CounterDrawCalls: SDL draw calls issued
+ * @CounterTextureBinds: Draw calls using another texture than the last one
+ * @NumProfileCounters: Number of counters
+ */
+typedef enum ProfileCounter
+{
+	CounterRays, CounterDdaSteps, CounterDrawCalls, CounterTextureBinds,
+	NumProfileCounters
+} ProfileCounter;
+
+/**
+ * struct ProfileEvent - One timed scope
+ * @stage: What was timed
+ * @start: Performance counter at the start of the scope
+ * @end: Performance counter at the end of the scope
+ */
+typedef struct ProfileEvent
+{
+	ProfileStage stage;
+	Uint64 start, end;
+} ProfileEvent;
+
+/**
+ * struct ProfileFrame - Everything the profiler recorded during one frame
+ * @start: Performance counter at the start of the frame
+ * @end: Performance counter at the end of the frame
+ * @stageTicks: Time spent in each stage, in performance counter ticks
+ * @counters: Value of each ProfileCounter
+ * @events: The scopes of the frame in the order they ended
+ * @numEvents: Number of entries in @events; later scopes are only summed
+ */
+typedef struct ProfileFrame
+{
+	Uint64 start, end;
+	Uint64 stageTicks[NumProfileStages];
+	Uint32 counters[NumProfileCounters];
+	ProfileEvent events[PROFILE_EVENTS];
+	int numEvents;
+} ProfileFrame;
+
+/**
+ * struct Profiler - Ring buffer of the last PROFILE_FRAMES frames
+ * @frames: The completed frames, plus @frames[@current] being recorded
+ * @current: Index of the frame being recorded
+ * @count: Number of completed frames in @frames
+ * @lastTexture: Texture of the last draw call, to count texture binds
+ */
+typedef struct Profiler
+{
+	ProfileFrame frames[PROFILE_FRAMES + 1];
+	int current;
+	int count;
+	SDL_Texture *lastTexture;
+} Profiler;
+
+/**
+ * PoolTask - A task run by every thread of a ThreadPool
+ * @arg: The argument given to thread_pool_run()
+ */
+typedef void (*PoolTask)(void *arg);
+
+typedef struct ThreadPool ThreadPool;
+
+/* Radius of the footprint of an entity, in cells */
+#define ENTITY_RADIUS 0.25f
+/* Speed of an enemy, in cells per second */
+#define ENEMY_SPEED 1.0f
+/* Periodic spawning stops once this many enemies are alive */
+#define ENEMY_SPAWN_LIMIT 10
+
+/**
+ * enum EntityType - The kinds of entity an EntityPool holds
+ * @EntityEnemy: An enemy
+ * @NumEntityTypes: Number of types
+ */
+typedef enum EntityType
+{
+	EntityEnemy,
+	NumEntityTypes
+} EntityType;
+
+/**
+ * struct EntityPool - Growable structure-of-arrays store of entities
+ * @count: Number of entities
+ * @capacity: Number of entities the arrays have room for
+ * @posX: X-coordinate of each entity
+ * @posY: Y-coordinate of each entity
+ * @velX: X velocity of each entity, in cells per second
+ * @velY: Y velocity of each entity, in cells per second
+ * @type: The EntityType of each entity
+ * @sprites: Shared image of each type; the pool holds one reference each
+ * @speeds: Speed of each type, in cells per second
+ * @numBuckets: Number of buckets of the spatial hash, a power of two
+ * @bucketStart: Where each bucket starts in @sorted; bucket b holds
+ * sorted[bucketStart[b]] up to, not including, sorted[bucketStart[b + 1]]
+ * @sorted: Entity indices grouped by the bucket of the map cell they are in
+ * @bucketOf: Scratch space for the bucket of each entity
+ * @hashValid: Whether @sorted matches the current positions
+ * @rng: State of the xorshift generator used for spawning
+ */
+typedef struct EntityPool
+{
+	int count, capacity;
+	float *posX, *posY;
+	float *velX, *velY;
+	uint8_t *type;
+	Asset *sprites[NumEntityTypes];
+	float speeds[NumEntityTypes];
+	int numBuckets;
+	int *bucketStart;
+	int *sorted;
+	uint32_t *bucketOf;
+	bool hashValid;
+	uint32_t rng;
+} EntityPool;
+
+/* The flow field covers the cells within this many of the player */
+#define FLOW_RADIUS 128
+#define FLOW_SIZE (2 * FLOW_RADIUS + 1)
+/* Cells the flow field search visits per simulation step */
+#define FLOW_STEP_BUDGET 16384
+/* Cell changes the field follows by patching before it is rebuilt */
+#define FLOW_PATCH_LIMIT 8
+/* Flow directions past the 8 neighbour offsets */
+#define FLOW_SOURCE 8
+#define FLOW_NONE 0xFF
+
+/**
+ * struct FlowField - Shortest-path directions toward the player
+ * @origin: The map cell of the first entry of @direction
+ * @direction: FLOW_SIZE x FLOW_SIZE window of cells, row-major; each holds
+ * the neighbour to step to, FLOW_SOURCE at the player or FLOW_NONE where
+ * the player cannot be reached
+ * @valid: Whether @direction has been built at all
+ * @source: The cell @direction flows to, moved along with the player
+ * @mapRevision: Map.revision @direction was built from
+ * @patches: Number of times @source was moved since @direction was built
+ * @buildSource: The cell the search in progress flows to
+ * @buildRevision: Map.revision the search in progress started from
+ * @buildOrigin: The map cell of the first entry of @building
+ * @building: The window being searched, swapped with @direction when done
+ * @queue: Breadth-first search queue of window cell indices
+ * @head: Index in @queue of the next cell to expand
+ * @tail: Index in @queue past the last queued cell
+ * @busy: Whether a search is in progress
+ */
+typedef struct FlowField
+{
+	Vec2I origin;
+	uint8_t *direction;
+	bool valid;
+	Vec2I source;
+	Uint32 mapRevision;
+	int patches;
+	Vec2I buildSource;
+	Uint32 buildRevision;
+	Vec2I buildOrigin;
+	uint8_t *building;
+	int *queue;
+	int head, tail;
+	bool busy;
+} FlowField;
+
+/**
+ * struct SpriteProjection - An entity projected onto the screen
+ * @entity: Index of the entity in its pool.
+ * @sprite: The image of the entity.
+ * @depth: Distance along the view direction, comparable to perpWallDist.
+ * @startX: The first screen column the sprite covers, before clipping.
+ * @size: The width and height of the sprite on screen in pixels.
+ * @firstVisible: The first column where the sprite is in front of the wall.
+ * @lastVisible: The last column where the sprite is in front of the wall.
+ */
+typedef struct SpriteProjection
+{
+	int entity;
+	const Asset *sprite;
+	float depth;
+	int startX;
+	int size;
+	int firstVisible;
+	int lastVisible;
+} SpriteProjection;
+
+/**
+ * struct SceneKey - Everything the cached 3D view depends on
+ * @view: The player the scene was rendered from
+ * @mapRevision: Map.revision when it was rendered
+ * @sprites: State.spriteHash of the enemies drawn over it
+ * @mapView: Whether the map view was drawn over it
+ * @scale: The view scale it was rendered at
+ * @assets: AssetRegistry.revision when it was rendered
+ */
+typedef struct SceneKey
+{
+	Player view;
+	Uint32 mapRevision;
+	uint64_t sprites;
+	bool mapView;
+	int scale;
+	Uint32 assets;
+} SceneKey;
+
+/**
+ * struct ViewScaler - Picks the resolution the 3D view is rendered at
+ * @scale: The current scale, in VIEW_SCALE_UNIT-ths of the window size
+ * @budgetMs: Time in ms rendering a frame should take, 0 to keep @scale
+ * @averageMs: Smoothed render time of the frames timed at @scale
+ * @samples: Number of frames timed at @scale
+ */
+typedef struct ViewScaler
+{
+	int scale;
+	float budgetMs;
+	float averageMs;
+	int samples;
+} ViewScaler;
+
+/* Size of a map cell in the map view, in window pixels */
+#define MINIMAP_TILE 10
+/* Cells shown along each axis; larger maps are cropped around the player */
+#define MINIMAP_VIEW_TILES 64
+/* Cells pre-rendered along each axis, so the crop can move before a redraw */
+#define MINIMAP_CACHE_TILES 96
+
+/**
+ * struct Minimap - The tiles of the map view, pre-rendered into a texture
+ * @texture: Render target holding the cells from @origin on, NULL if the
+ * renderer cannot render to textures
+ * @walls: Room for the wall rectangles of one redraw
+ * @valid: Whether @texture holds the tiles of @map
+ * @map: The map it was drawn from
+ * @revision: Map.revision when it was drawn
+ * @origin: The first cell it holds
+ * @size: Number of cells it holds along x and y
+ * @view: The first cell shown
+ * @viewSize: Number of cells shown along x and y
+ */
+typedef struct Minimap
 {
-	Vec2F pos;
 	SDL_Texture *texture;
-} Enemy;
+	SDL_Rect *walls;
+	bool valid;
+	const Map *map;
+	Uint32 revision;
+	Vec2I origin;
+	Vec2I size;
+	Vec2I view;
+	Vec2I viewSize;
+} Minimap;
+
+/* Start and version of input recordings */
+#define REPLAY_MAGIC "RCREC\x1a\n"
+#define REPLAY_VERSION 2
+/* Longest map path, terminating NUL included, a recording can name */
+#define REPLAY_PATH_MAX 256
+/* Bits of ReplayFrame.flags */
+#define REPLAY_MAP_VIEW 0x01
+
+/**
+ * enum ReplayMode - What is done with the input of the current run
+ * @ReplayOff: The simulation reads the live keyboard
+ * @ReplayRecord: It reads the live keyboard, which is written to a file
+ * @ReplayPlay: It reads the input recorded in a file
+ */
+typedef enum ReplayMode
+{
+	ReplayOff,
+	ReplayRecord,
+	ReplayPlay
+} ReplayMode;
+
+/**
+ * struct ReplayHeader - Start of an input recording, in native byte order
+ * @magic: REPLAY_MAGIC, including its terminating NUL
+ * @version: REPLAY_VERSION
+ * @initialEnemies: State.initialEnemies of the recorded run
+ * @frames: Number of frames recorded
+ * @steps: Number of simulation steps recorded
+ * @finalHash: hash_game_state() at the end of the recorded run
+ * @pageBudget: State.pageBudget of the recorded run
+ * @mapPath: The map the run was recorded on
+ */
+typedef struct ReplayHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t initialEnemies;
+	uint64_t frames;
+	uint64_t steps;
+	uint64_t finalHash;
+	uint64_t pageBudget;
+	char mapPath[REPLAY_PATH_MAX];
+} ReplayHeader;
+
+/**
+ * struct ReplayFrame - One recorded frame, followed by one byte of key bits
+ * per simulation step
+ * @steps: Number of simulation steps run in the frame
+ * @flags: REPLAY_* state of the frame
+ * @alpha: How far between the last two steps the frame was rendered, in
+ * 65535-ths
+ */
+typedef struct ReplayFrame
+{
+	uint8_t steps;
+	uint8_t flags;
+	uint16_t alpha;
+} ReplayFrame;
+
+/**
+ * struct ReplayTiming - How long a replayed frame took
+ * @frameMs: The whole frame
+ * @renderMs: Rendering and compositing it, negative if the cached view was
+ * shown
+ * @steps: Number of simulation steps run in it
+ */
+typedef struct ReplayTiming
+{
+	float frameMs;
+	float renderMs;
+	int steps;
+} ReplayTiming;
+
+/**
+ * struct Replay - Input recording or playback of the current run
+ * @mode: Whether the input is recorded, replayed or neither
+ * @path: The recording
+ * @timingsPath: Where the timing of every replayed frame is written as CSV
+ * on exit, or NULL
+ * @file: The open recording
+ * @header: The header of the recording
+ * @frame: The frame being recorded or replayed
+ * @ticks: Key bits of each simulation step of @frame
+ * @tick: Number of steps of @frame recorded or replayed so far
+ * @keys: Keyboard state the simulation reads while replaying
+ * @timings: Timing of every replayed frame
+ * @count: Number of entries in @timings
+ * @capacity: Number of entries allocated in @timings
+ * @failed: Whether reading or writing the recording failed
+ */
+typedef struct Replay
+{
+	ReplayMode mode;
+	const char *path;
+	const char *timingsPath;
+	FILE *file;
+	ReplayHeader header;
+	ReplayFrame frame;
+	uint8_t ticks[SIM_MAX_STEPS];
+	int tick;
+	uint8_t keys[SDL_NUM_SCANCODES];
+	ReplayTiming *timings;
+	int count;
+	int capacity;
+	bool failed;
+} Replay;
 
 /**
  * struct State - Holds the window, renderer, and state of the game loop.
@@ -110,12 +961,57 @@ typedef struct Enemy
  * @renderer: Pointer to the SDL_Renderer structure for rendering.
  * @quit: Boolean indicating if the game loop should quit.
  * @mapViewEnabled: Boolean for enabling/disabling map view.
- * @wallTextures: Array of textures for the walls.
- * @floorTextures: Array of textures for the floor.
- * @weaponTexture: Array of textures for weapons.
- * @enemies: Array of enemies in the game.
- * @numEnemies: Current number of enemies.
- * @enemySpawnTimer: Timer for controlling the enemy spawn rate.
+ * @assets: Registry owning every texture the game has loaded.
+ * @wallTiles: Wall texture of each of the 256 map tile values.
+ * @floorTiles: Floor texture of each map tile value, NULL for a flat color.
+ * @ceilingTiles: Ceiling texture of each tile value, NULL for a flat color.
+ * @weapon: The image of the player's weapon.
+ * @enemySprite: The image newly spawned enemies share.
+ * @enemies: The enemies in the game.
+ * @initialEnemies: Number of enemies scattered over the map at startup.
+ * @flow: Directions the enemies follow toward the player.
+ * @sprites: Room for the projection of every enemy, grown with @enemies.
+ * @nearby: Room for the index of every enemy, grown with @enemies.
+ * @spriteCapacity: Number of entries @sprites and @nearby have room for.
+ * @spriteHash: Hash of the projections project_enemies() last stored in
+ * @sprites, which tells whether the enemies would be drawn differently.
+ * @enemySpawnTimer: Simulated time in ms the last enemy spawned at.
+ * @simSteps: Number of fixed simulation steps run so far.
+ * @vsync: Whether presenting waits for the display refresh, chosen at
+ * startup.
+ * @profiler: Frame timings and counters; only written while @profiling.
+ * @profiling: Whether the profiler records and its overlay is shown.
+ * @toggleProfiling: Whether P was pressed; @profiling flips before the
+ * next frame starts, so no frame is left half recorded.
+ * @profileCsv: Where the recorded frames are written as CSV on exit, or NULL.
+ * @profileTrace: Where they are written as a Chrome trace on exit, or NULL.
+ * @mapPath: The map file loaded at startup.
+ * @pageBudget: Tile memory in bytes a paged binary map may keep resident,
+ * or 0 to load the whole map up front.
+ * @renderMode: Path used to draw the 3D view, chosen at startup.
+ * @frameTexture: Streaming texture CPU-drawn pixels are uploaded to, big
+ * enough for the largest view; only its top-left @viewW x @viewH is used.
+ * @wallSpans: Room for one WallSpan per column, used by render_walls().
+ * @wallVertices: Room for the 4 vertices of every span.
+ * @wallIndices: Room for the 6 indices of every span.
+ * @sceneTexture: Render target holding the last 3D view in its top-left
+ * @viewW x @viewH pixels, NULL if the renderer cannot render to textures.
+ * @sceneKey: What @sceneTexture was rendered from.
+ * @scaler: Adapts the resolution of the 3D view to the frame budget.
+ * @viewW: Width of the 3D view in pixels, from @scaler.
+ * @viewH: Height of the 3D view in pixels, from @scaler.
+ * @sceneValid: Whether @sceneTexture holds a scene at all.
+ * @presentNeeded: Whether the window must be redrawn even if nothing in
+ * the game changed, e.g. after it was exposed.
+ * @numThreads: Number of threads casting rays, chosen at startup.
+ * @pool: Worker threads that cast the rays of each frame.
+ * @simdDda: Whether rays are traversed 8 at a time with the AVX2 kernel.
+ * @columnHits: Ray hit of every column of the 3D view for the current frame.
+ * @colormap: Lighting table shared by every renderer, from build_colormap().
+ * @minimap: The tiles of the map view, drawn once and reused.
+ * @replay: Recording or playback of the input of the run.
+ * @headless: Whether SDL runs without a display, on its offscreen (or
+ * dummy) video driver.
  */
 typedef struct State
 {
@@ -123,12 +1019,48 @@ typedef struct State
 	SDL_Renderer *renderer;
 	bool quit;
 	bool mapViewEnabled;
-	SDL_Texture *wallTextures[4];
-	SDL_Texture *floorTextures[4];
-	SDL_Texture *weaponTexture[4];
-	Enemy enemies[10];  /* Array of enemies */
-	int numEnemies;
+	AssetRegistry assets;
+	Asset *wallTiles[256];
+	Asset *floorTiles[256];
+	Asset *ceilingTiles[256];
+	Asset *weapon;
+	Asset *enemySprite;
+	EntityPool enemies;
+	int initialEnemies;
+	FlowField flow;
+	SpriteProjection *sprites;
+	int *nearby;
+	int spriteCapacity;
+	uint64_t spriteHash;
 	Uint32 enemySpawnTimer;  /* Timer for spawning enemies */
+	Uint64 simSteps;
+	bool vsync;
+	Profiler *profiler;
+	bool profiling;
+	bool toggleProfiling;
+	const char *profileCsv;
+	const char *profileTrace;
+	const char *mapPath;
+	size_t pageBudget;
+	RenderMode renderMode;
+	SDL_Texture *frameTexture;
+	WallSpan *wallSpans;
+	SDL_Vertex *wallVertices;
+	int *wallIndices;
+	SDL_Texture *sceneTexture;
+	SceneKey sceneKey;
+	ViewScaler scaler;
+	int viewW, viewH;
+	bool sceneValid;
+	bool presentNeeded;
+	int numThreads;
+	ThreadPool *pool;
+	bool simdDda;
+	ColumnHit columnHits[VIEW_MAX_W];
+	Colormap colormap;
+	Minimap minimap;
+	Replay replay;
+	bool headless;
 } State;
 
 #define RGBA_Red ((ColorRGBA) {.r = 0xFF, .g = 0x00, .b = 0x00, .a = 0xFF})
@@ -138,33 +1070,183 @@ typedef struct State
 #define RGBA_Ceiling ((ColorRGBA) {.r = 0x1E, .g = 0x90, .b = 0xFF, .a = 0xFF})
 #define RGBA_Ground ((ColorRGBA) {.r = 0x22, .g = 0x8B, .b = 0x22, .a = 0xFF})
 
-int main(void);
-bool load_map(const char *filename, uint8_t (*MAP)[MAP_SIZE * MAP_SIZE]);
-void render(State *state, Player *player, uint8_t MAP[MAP_SIZE * MAP_SIZE]);
+/**
+ * profile_begin - Starts timing a scope.
+ * @state: The game state.
+ * Return: The value to pass to profile_end(), 0 when not profiling.
+ */
+static inline Uint64 profile_begin(const State *state)
+{
+	return (state->profiling ? SDL_GetPerformanceCounter() : 0);
+}
+
+void record_profile_scope(Profiler *profiler, ProfileStage stage,
+	Uint64 start);
+
+/**
+ * profile_end - Finishes timing a scope and records it.
+ * @state: The game state.
+ * @stage: The stage the scope belongs to.
+ * @start: What profile_begin() returned; scopes begun while the profiler
+ * was off pass 0 and are not recorded.
+ */
+static inline void profile_end(State *state, ProfileStage stage, Uint64 start)
+{
+	if (state->profiling && start != 0)
+		record_profile_scope(state->profiler, stage, start);
+}
+
+/**
+ * profile_count - Adds to a counter of the current frame.
+ * @state: The game state.
+ * @counter: The counter.
+ * @amount: What to add.
+ */
+static inline void profile_count(State *state, ProfileCounter counter,
+	Uint32 amount)
+{
+	if (state->profiling)
+		state->profiler->frames[state->profiler->current].counters[counter] +=
+			amount;
+}
+
+/**
+ * profile_draw - Counts a draw call and whether it binds another texture.
+ * @state: The game state.
+ * @texture: The texture drawn with, NULL for untextured primitives.
+ */
+static inline void profile_draw(State *state, SDL_Texture *texture)
+{
+	if (!state->profiling)
+		return;
+	profile_count(state, CounterDrawCalls, 1);
+	if (texture && texture != state->profiler->lastTexture)
+		profile_count(state, CounterTextureBinds, 1);
+	state->profiler->lastTexture = texture ? texture :
+		state->profiler->lastTexture;
+}
+
+int main(int argc, char **argv);
+bool parse_args(int argc, char **argv, State *state);
+bool read_map_file(const char *filename, Map *map);
+bool load_map(const char *filename, Map *map);
+bool load_binary_map(const char *filename, Map *map);
+bool save_binary_map(const char *filename, const Map *map);
+bool check_map_header(const MapFileHeader *header, size_t fileSize);
+bool check_player_spawn(const Map *map);
+bool open_paged_map(const char *filename, Map *map, size_t budgetBytes);
+void update_map_paging(Map *map, Vec2F pos, Vec2F velocity, bool sync);
+void close_map_pager(Map *map);
+bool init_map(Map *map, int width, int height);
+size_t map_tiles_size(const Map *map);
+int map_chunk_count(const Map *map);
+bool init_chunk_table(Map *map, uint8_t *tiles);
+void set_map_tile(Map *map, int x, int y, uint8_t tile);
+bool build_distance_field(Map *map);
+void free_map(Map *map);
+void render(State *state, Player *player, const Map *map);
+bool render_scene(State *state, Player *player, const Map *map);
+void render_walls(State *state, const Map *map);
 float calculate_wall_distance(Side side, Vec2F *sideDist, Vec2F *deltaDist);
-void render_column(State *state, int x, int lineHeight, Side side,
-	Vec2I mapBox, uint8_t MAP[MAP_SIZE * MAP_SIZE], float perpWallDist,
-		Vec2F rayDir, Player *player);
-bool perform_dda(Vec2I *mapBox, Vec2F *sideDist,
-	Vec2F *deltaDist, Vec2I *stepDir, Side *side, uint8_t [MAP_SIZE * MAP_SIZE]);
-Vec2F calculate_ray_direction(Player *player, int x);
+void render_column(State *state, int x, const ColumnHit *hit,
+	const Map *map);
+void cast_column(Player *player, int x, int width, const Map *map,
+	ColumnHit *hit);
+void cast_columns(State *state, Player *player,
+	const Map *map);
+void choose_dda_kernel(State *state, Player *player, const Map *map);
+bool dda_avx2_supported(void);
+void perform_dda_avx2(Vec2I mapBox[8], Vec2F sideDist[8],
+	const Vec2F deltaDist[8], const Vec2I stepDir[8], Side side[8],
+	const Map *map);
+ThreadPool *create_thread_pool(int numThreads);
+int thread_pool_size(ThreadPool *pool);
+void thread_pool_run(ThreadPool *pool, PoolTask task, void *arg);
+void destroy_thread_pool(ThreadPool *pool);
+int perform_dda(Vec2I *mapBox, Vec2F *sideDist,
+	Vec2F *deltaDist, Vec2I *stepDir, Side *side, const Map *map);
+void skip_empty_cells(Vec2I *mapBox, Vec2F *sideDist,
+	Vec2F *deltaDist, Vec2I *stepDir, Side *side, int cells);
+void cast_rays(ThreadPool *pool, const Map *map, const RayQuery *rays,
+	int count, RayHit *hits);
+void test_occlusion(ThreadPool *pool, const Map *map, const RayQuery *rays,
+	int count, bool *blocked);
+Vec2F calculate_ray_direction(Player *player, int x, int width);
 void initialize_raycasting(Player *player, Vec2F rayDir,
 	Vec2I *mapBox, Vec2F *sideDist, Vec2F *deltaDist, Vec2I *stepDir);
-int xy2index(int x, int y, int w);
 void cleanup(State *state);
 void update_player(Player *player, const uint8_t *keystate, float moveSpeed,
-	uint8_t [MAP_SIZE * MAP_SIZE]);
-void handle_input(State *state, Player *player, float rotateSpeed);
+	const Map *map);
+void handle_input(State *state, Player *player, const uint8_t *keystate,
+	float rotateSpeed);
+void poll_events(State *state);
+Profiler *create_profiler(void);
+void profile_begin_frame(State *state);
+void profile_end_frame(State *state);
+void draw_profiler_overlay(State *state);
+bool export_profile_csv(const Profiler *profiler, const char *path);
+bool export_profile_trace(const Profiler *profiler, const char *path);
+void step_simulation(State *state, Player *player, const Map *map);
+bool start_replay(State *state);
+bool read_replay_frame(Replay *replay, int *steps, float *alpha,
+	bool *mapView);
+const uint8_t *replay_keys(Replay *replay);
+void write_replay_frame(Replay *replay, float alpha, bool mapView);
+void time_replay_frame(Replay *replay, float frameMs, float renderMs);
+uint64_t hash_game_state(const State *state, const Player *player);
+bool finish_replay(Replay *replay, uint64_t hash);
+Player interpolate_player(const Player *from, const Player *to, float alpha);
 void initialize_sdl(State *state);
 Player initialize_player(void);
-void draw_map(State *state, uint8_t MAP[MAP_SIZE * MAP_SIZE]);
+void update_minimap(State *state, const Map *map, Vec2F pos);
+void draw_map(State *state, const Map *map);
 void draw_player(State *state, Player *player);
-SDL_Texture *load_texture(SDL_Renderer *renderer, const char *path);
-void render_ground(State *state, int x, int lineHeight, Vec2I mapBox,
-	uint8_t MAP[MAP_SIZE * MAP_SIZE], float perpWallDist, Player *player);
+SDL_Texture *upload_texels(SDL_Renderer *renderer, const Texels *texels);
+bool load_texels(const char *path, Texels *texels);
+void free_texels(Texels *texels);
+size_t layout_column_mips(ColumnMips *mips, int w, int h, uint32_t *pixels);
+ColumnMips build_column_mips(const Texels *texels);
+void free_column_mips(ColumnMips *mips);
+void build_colormap(Colormap colormap);
+int wall_light(const ColumnHit *hit);
+bool open_texture_pack(const char *filename, TexturePack *pack);
+bool find_packed_texture(const TexturePack *pack, const char *path,
+	Texels *texels, ColumnMips *columns);
+void close_texture_pack(TexturePack *pack);
+bool save_texture_pack(const char *filename, char **paths, int count);
+void init_asset_registry(AssetRegistry *registry, SDL_Renderer *renderer);
+Asset *acquire_asset(AssetRegistry *registry, const char *path);
+Asset *retain_asset(Asset *asset);
+void release_asset(AssetRegistry *registry, Asset *asset);
+bool poll_assets(AssetRegistry *registry);
+void wait_for_assets(AssetRegistry *registry);
+void destroy_asset_registry(AssetRegistry *registry);
+void render_software(State *state, Player *player,
+	const Map *map);
+void draw_column_software(uint32_t *pixels, int pitch, int height, int x,
+	int lineHeight, const uint8_t *shade, const ColumnMips *mips, float wallX);
+void render_floor_ceiling(State *state, Player *player,
+	const Map *map, uint32_t *pixels, int pitch);
 void render_weapon(State *state);
-Enemy initialize_enemy(SDL_Renderer *renderer);
-void handle_enemies(State *state);
+void set_view_scale(State *state, int scale);
+void update_view_scale(State *state, float renderMs);
+void init_entity_pool(EntityPool *pool);
+void free_entity_pool(EntityPool *pool, AssetRegistry *registry);
+int spawn_entity(EntityPool *pool, EntityType type, Vec2F pos);
+void scatter_entities(EntityPool *pool, const Map *map, EntityType type,
+	int count);
+void update_entities(EntityPool *pool, const Map *map,
+	const FlowField *flow, float dt);
+int query_entities(const EntityPool *pool, Vec2F center, float radius,
+	int *out, int max);
+void init_flow_field(FlowField *flow);
+void free_flow_field(FlowField *flow);
+void update_flow_field(FlowField *flow, const Map *map, Vec2I source);
+bool flow_target(const FlowField *flow, Vec2I cell, Vec2F *target);
+void handle_enemies(State *state, const Map *map, const Player *player);
+int project_enemies(State *state, Player *player);
 void render_enemies(State *state, Player *player);
+void draw_enemies_software(State *state, Player *player, uint32_t *pixels,
+	int pitch);
 
 #endif
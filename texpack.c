@@ -0,0 +1,259 @@
+#include "structure.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Pixel data starts on a cache line boundary of the file */
+#define TEXPACK_ALIGN 64
+
+/**
+ * pack_path - Skips the "./" a path may start with.
+ * @path: The path.
+ * Return: The path as it is stored in a texture pack.
+ */
+static const char *pack_path(const char *path)
+{
+	while (path[0] == '.' && path[1] == '/')
+		path += 2;
+	return (path);
+}
+
+/**
+ * check_pack_entry - Validates one entry of a texture pack.
+ * @entry: The entry.
+ * @fileSize: The size of the whole file.
+ * Return: true if the entry's pixels lie inside the file.
+ */
+static bool check_pack_entry(const TexPackEntry *entry, size_t fileSize)
+{
+	ColumnMips mips;
+	size_t texels;
+
+	if (memchr(entry->path, '\0', sizeof(entry->path)) == NULL ||
+		entry->w == 0 || entry->h == 0 ||
+		entry->w > 32768 || entry->h > 32768)
+		return (false);
+	texels = (size_t)entry->w * entry->h * sizeof(uint32_t);
+	if (entry->texelsOffset % sizeof(uint32_t) != 0 ||
+		entry->mipsOffset % sizeof(uint32_t) != 0 ||
+		entry->texelsOffset > fileSize || texels > fileSize -
+		entry->texelsOffset || entry->mipsOffset > fileSize)
+		return (false);
+	return (layout_column_mips(&mips, entry->w, entry->h, NULL) *
+		sizeof(uint32_t) <= fileSize - entry->mipsOffset);
+}
+
+/**
+ * open_texture_pack - Maps a texture pack file into memory.
+ * @filename: The name of the pack file.
+ * @pack: Where the pack is stored; close it with close_texture_pack().
+ * Return: true if the pack is open, false if there is none or it cannot be
+ * used; only the latter is reported, a missing pack is not an error.
+ * Description: The file is mapped read-only, so the pixels are only read
+ * from disk when first touched and are shared with the page cache.
+ */
+bool open_texture_pack(const char *filename, TexturePack *pack)
+{
+	int fd = open(filename, O_RDONLY);
+	struct stat info;
+	const TexPackHeader *header;
+	uint8_t *base;
+
+	memset(pack, 0, sizeof(*pack));
+	if (fd < 0)
+		return (false);
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TexPackHeader))
+	{
+		printf("Truncated or corrupt texture pack %s\n", filename);
+		close(fd);
+		return (false);
+	}
+	base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+	{
+		printf("Failed to map %s\n", filename);
+		return (false);
+	}
+	header = (const TexPackHeader *)base;
+	if (memcmp(header->magic, TEXPACK_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != TEXPACK_VERSION || header->count >
+		(info.st_size - sizeof(TexPackHeader)) / sizeof(TexPackEntry))
+	{
+		printf("Unsupported or corrupt texture pack %s\n", filename);
+		munmap(base, info.st_size);
+		return (false);
+	}
+	pack->entries = (const TexPackEntry *)(base + sizeof(TexPackHeader));
+	for (uint32_t i = 0; i < header->count; i++)
+	{
+		if (check_pack_entry(&pack->entries[i], info.st_size))
+			continue;
+		printf("Truncated or corrupt texture pack %s\n", filename);
+		munmap(base, info.st_size);
+		memset(pack, 0, sizeof(*pack));
+		return (false);
+	}
+	pack->mapping = base;
+	pack->size = info.st_size;
+	pack->count = header->count;
+	return (true);
+}
+
+/**
+ * find_packed_texture - Looks up a baked image that is still up to date.
+ * @pack: The pack, may have no mapping.
+ * @path: The path of the source image.
+ * @texels: Where the row-major texels are stored on success.
+ * @columns: Where the mip chain is stored on success.
+ * Return: true if the pack holds the image, false if it does not or the
+ * source file changed since it was baked.
+ * Description: Both point straight into the mapping; they are read-only
+ * and must not be freed.
+ */
+bool find_packed_texture(const TexturePack *pack, const char *path,
+	Texels *texels, ColumnMips *columns)
+{
+	const char *key = pack_path(path);
+	struct stat info;
+
+	for (int i = 0; i < pack->count; i++)
+	{
+		const TexPackEntry *entry = &pack->entries[i];
+		uint8_t *base = pack->mapping;
+
+		if (strcmp(entry->path, key) != 0)
+			continue;
+		if (stat(path, &info) != 0 ||
+			(uint64_t)info.st_size != entry->sourceSize ||
+			(int64_t)info.st_mtime != entry->sourceMtime)
+			return (false);
+		texels->w = entry->w;
+		texels->h = entry->h;
+		texels->pixels = (uint32_t *)(base + entry->texelsOffset);
+		layout_column_mips(columns, entry->w, entry->h,
+			(uint32_t *)(base + entry->mipsOffset));
+		return (true);
+	}
+	return (false);
+}
+
+/**
+ * close_texture_pack - Unmaps a texture pack.
+ * @pack: The pack, may have no mapping.
+ */
+void close_texture_pack(TexturePack *pack)
+{
+	if (pack->mapping)
+		munmap(pack->mapping, pack->size);
+	memset(pack, 0, sizeof(*pack));
+}
+
+/**
+ * write_padding - Pads a file being written with zeros up to an offset.
+ * @file: The file.
+ * @offset: The offset to pad to.
+ * Return: true if the padding was written.
+ */
+static bool write_padding(FILE *file, uint64_t offset)
+{
+	long position = ftell(file);
+
+	for (uint64_t i = position < 0 ? offset : (uint64_t)position;
+		i < offset; i++)
+		if (fputc(0, file) == EOF)
+			return (false);
+	return (position >= 0);
+}
+
+/**
+ * bake_texture - Decodes one image and fills its entry of a new pack.
+ * @path: The path of the source image.
+ * @entry: The entry; its offsets are left to the caller.
+ * @texels: Where the decoded texels are stored.
+ * @mips: Where their mip chain is stored.
+ * Return: true on success, false if the image cannot be used.
+ */
+static bool bake_texture(const char *path, TexPackEntry *entry,
+	Texels *texels, ColumnMips *mips)
+{
+	struct stat info;
+
+	if (strlen(pack_path(path)) >= sizeof(entry->path))
+	{
+		printf("Path too long for a texture pack: %s\n", path);
+		return (false);
+	}
+	if (stat(path, &info) != 0 || !load_texels(path, texels))
+		return (false);
+	*mips = build_column_mips(texels);
+	strcpy(entry->path, pack_path(path));
+	entry->sourceSize = info.st_size;
+	entry->sourceMtime = info.st_mtime;
+	entry->w = texels->w;
+	entry->h = texels->h;
+	return (true);
+}
+
+/**
+ * save_texture_pack - Bakes images into a pack open_texture_pack() reads
+ * @filename: The name of the file to write.
+ * @paths: The paths of the images, as the game acquires them.
+ * @count: The number of images.
+ * Return: true if every image was baked and the whole file was written.
+ * Description: Each image is stored as its ARGB8888 texels followed by
+ * its column-major mip chain, so loading it is a lookup in the index.
+ */
+bool save_texture_pack(const char *filename, char **paths, int count)
+{
+	TexPackHeader header = {.version = TEXPACK_VERSION, .count = count};
+	TexPackEntry *entries = calloc(count ? count : 1, sizeof(TexPackEntry));
+	uint64_t offset = sizeof(header) + sizeof(TexPackEntry) * count;
+	FILE *file;
+	bool ok = true;
+
+	ASSERT(entries, "Out of memory\n");
+	file = fopen(filename, "wb");
+	if (!file)
+	{
+		printf("Failed to open %s for writing\n", filename);
+		free(entries);
+		return (false);
+	}
+	memcpy(header.magic, TEXPACK_MAGIC, sizeof(header.magic));
+	ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+		(int)fwrite(entries, sizeof(TexPackEntry), count, file) == count;
+	for (int i = 0; ok && i < count; i++)
+	{
+		Texels texels;
+		ColumnMips mips, sized;
+		size_t mipTexels;
+
+		ok = bake_texture(paths[i], &entries[i], &texels, &mips);
+		if (!ok)
+			break;
+		mipTexels = layout_column_mips(&sized, texels.w, texels.h, NULL);
+		offset = (offset + TEXPACK_ALIGN - 1) & ~(uint64_t)(TEXPACK_ALIGN - 1);
+		entries[i].texelsOffset = offset;
+		offset += sizeof(uint32_t) * texels.w * texels.h;
+		offset = (offset + TEXPACK_ALIGN - 1) & ~(uint64_t)(TEXPACK_ALIGN - 1);
+		entries[i].mipsOffset = offset;
+		offset += sizeof(uint32_t) * mipTexels;
+		ok = write_padding(file, entries[i].texelsOffset) &&
+			fwrite(texels.pixels, sizeof(uint32_t) * texels.w * texels.h, 1,
+				file) == 1 &&
+			write_padding(file, entries[i].mipsOffset) &&
+			fwrite(mips.level[0].pixels, sizeof(uint32_t) * mipTexels, 1,
+				file) == 1;
+		free_texels(&texels);
+		free_column_mips(&mips);
+	}
+	ok = ok && fseek(file, sizeof(header), SEEK_SET) == 0 &&
+		(int)fwrite(entries, sizeof(TexPackEntry), count, file) == count;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		printf("Failed to write %s\n", filename);
+	free(entries);
+	return (ok);
+}
@@ -1,67 +1,344 @@
 #include "structure.h"
 
-SDL_Texture *load_texture(SDL_Renderer *renderer, const char *path)
+/**
+ * upload_texels - Creates a GPU texture holding a copy of decoded texels.
+ * @renderer: The renderer the texture is created on.
+ * @texels: The decoded ARGB8888 pixels.
+ * Return: The texture; the program exits if it cannot be created.
+ * Description: Blending is only enabled when some texel is not opaque.
+ */
+SDL_Texture *upload_texels(SDL_Renderer *renderer, const Texels *texels)
 {
-	SDL_Texture *texture = IMG_LoadTexture(renderer, path);
+	SDL_Texture *texture = SDL_CreateTexture(renderer,
+		SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+		texels->w, texels->h);
 
 	if (!texture)
 	{
 		fprintf(stderr, "Failed to load texture: %s\n", SDL_GetError());
 		exit(1);
 	}
+	SDL_UpdateTexture(texture, NULL, texels->pixels,
+		texels->w * sizeof(uint32_t));
+	for (int i = 0; i < texels->w * texels->h; i++)
+	{
+		if (texels->pixels[i] >> 24 == 0xFF)
+			continue;
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+		break;
+	}
 	return (texture);
 }
 
 /**
- * render_ground - Renders the textured ground based on the player's view.
- * @state: A pointer to the State structure containing SDL resources.
- * @x: The x-coordinate of the column to render on the screen.
- * @lineHeight: The height of the column to render.
- * @mapBox: The map coordinates (grid position) of the ground to render.
- * @MAP: The game map array used during the game.
- * @perpWallDist: The perpendicular distance from the player to the wall.
- * @player: A pointer to the Player structure representing the player's
- * position and direction.
- * Return: None
+ * load_texels - Decodes an image into a CPU-side ARGB8888 pixel buffer.
+ * @path: The path of the image file.
+ * @texels: Where the decoded texels are stored.
+ * Return: true on success, false if the image cannot be decoded.
+ * Description: Only touches the CPU, so it may run on any thread.
  */
-void render_ground(State *state, int x, int lineHeight, Vec2I mapBox,
-	uint8_t MAP[MAP_SIZE * MAP_SIZE], float perpWallDist, Player *player)
+bool load_texels(const char *path, Texels *texels)
 {
-	(void)perpWallDist;
-	(void)player;
-	int drawStart, drawEnd;
-	SDL_Rect srcRect, dstRect;
-	SDL_Texture *texture;
-
-	/* Define the color for the ground */
-	/* SDL_SetRenderDrawColor(state->renderer, 0, 255, 0, 255); */
-	/* Green color (R, G, B, A) */
-
-	drawStart = -lineHeight / 2 + SCREEN_H / 2;
-	if (drawStart < 0)
-		drawStart = 0;
-	drawEnd = lineHeight / 2 + SCREEN_H / 2;
-	if (drawEnd >= SCREEN_H)
-		drawEnd = SCREEN_H;
-
-	texture = state->floorTextures[MAP[xy2index(mapBox.x, mapBox.y, MAP_SIZE)]];
-
-	/* Update srcRect to cover the entire texture */
-	srcRect.x = 0;
-	srcRect.y = 0;
-	srcRect.w = 512; /* Assuming the texture width is 512 */
-	srcRect.h = 512; /* Assuming the texture height is 512 */
-
-	/* Set the dstRect to cover the ground area */
-	dstRect.x = x;
-	dstRect.y = drawEnd;
-	dstRect.w = 1; /* Width of the column */
-	dstRect.h = SCREEN_H - drawEnd;
-	/* Height from the bottom of the wall to the bottom of the screen */
-
-	/* Render the ground texture as a filled rectangle */
-	/* Adjust the texture coordinates if needed to ensure proper mapping */
-	SDL_RenderCopy(state->renderer, texture, &srcRect, &dstRect);
+	SDL_Surface *image = IMG_Load(path), *argb;
+
+	if (!image)
+	{
+		fprintf(stderr, "Failed to load image %s: %s\n", path,
+			IMG_GetError());
+		return (false);
+	}
+	argb = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_ARGB8888, 0);
+	SDL_FreeSurface(image);
+	if (!argb)
+	{
+		fprintf(stderr, "Failed to convert image %s: %s\n", path,
+			SDL_GetError());
+		return (false);
+	}
+
+	texels->w = argb->w;
+	texels->h = argb->h;
+	texels->pixels = malloc(sizeof(uint32_t) * texels->w * texels->h);
+	ASSERT(texels->pixels, "Out of memory loading %s\n", path);
+	for (int y = 0; y < texels->h; y++)
+		memcpy(&texels->pixels[y * texels->w],
+			(uint8_t *)argb->pixels + y * argb->pitch,
+			sizeof(uint32_t) * texels->w);
+	SDL_FreeSurface(argb);
+	return (true);
+}
+
+/**
+ * free_texels - Releases the pixel buffer of a Texels structure.
+ * @texels: The texels to release.
+ */
+void free_texels(Texels *texels)
+{
+	free(texels->pixels);
+	texels->pixels = NULL;
+	texels->w = 0;
+	texels->h = 0;
+}
+
+/**
+ * average_texels - Box filters four ARGB8888 texels into one.
+ * @a: The first texel.
+ * @b: The second texel.
+ * @c: The third texel.
+ * @d: The fourth texel.
+ * Return: The rounded per-channel average, alpha included.
+ */
+static uint32_t average_texels(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+	uint32_t color = 0;
+
+	for (int shift = 0; shift < 32; shift += 8)
+	{
+		uint32_t sum = (a >> shift & 0xFF) + (b >> shift & 0xFF) +
+			(c >> shift & 0xFF) + (d >> shift & 0xFF);
+
+		color |= (sum + 2) / 4 << shift;
+	}
+	return (color);
+}
+
+/**
+ * layout_column_mips - Sizes the levels of a mip chain and places them.
+ * @mips: Where the levels are described.
+ * @w: The width of level 0.
+ * @h: The height of level 0.
+ * @pixels: Where level 0 starts, with every smaller level right after the
+ * one above; NULL to only size the chain.
+ * Return: The number of texels of the whole chain.
+ */
+size_t layout_column_mips(ColumnMips *mips, int w, int h, uint32_t *pixels)
+{
+	size_t total = 0;
+
+	memset(mips, 0, sizeof(*mips));
+	mips->pow2 = (w & (w - 1)) == 0 && (h & (h - 1)) == 0;
+	while (true)
+	{
+		mips->level[mips->levels++] = (Texels) {w, h,
+			pixels ? pixels + total : NULL};
+		total += (size_t)w * h;
+		if ((w == 1 && h == 1) || mips->levels == MAX_MIP_LEVELS)
+			break;
+		w = MAX(w / 2, 1);
+		h = MAX(h / 2, 1);
+	}
+	return (total);
+}
+
+/**
+ * build_column_mips - Transposes texels and builds their mip chain.
+ * @texels: The decoded row-major texels.
+ * Return: The mip chain; the program exits if memory runs out.
+ * Description: Walls and sprites are drawn one screen column at a time,
+ * which walks down a texture column; stored column-major those reads are
+ * sequential. Each level averages 2x2 texels of the one above, clamping at
+ * odd edges, so distant walls read a small level instead of skipping
+ * through the full-size one.
+ */
+ColumnMips build_column_mips(const Texels *texels)
+{
+	ColumnMips mips;
+	size_t total = layout_column_mips(&mips, texels->w, texels->h, NULL);
+	uint32_t *pixels = malloc(sizeof(uint32_t) * total);
+
+	ASSERT(pixels, "Out of memory building mipmaps\n");
+	layout_column_mips(&mips, texels->w, texels->h, pixels);
+	for (int x = 0; x < texels->w; x++)
+		for (int y = 0; y < texels->h; y++)
+			pixels[x * texels->h + y] = texels->pixels[y * texels->w + x];
+	for (int i = 1; i < mips.levels; i++)
+	{
+		const Texels *src = &mips.level[i - 1];
+		Texels *dst = &mips.level[i];
+
+		for (int x = 0; x < dst->w; x++)
+		{
+			const uint32_t *left = src->pixels + 2 * x * src->h;
+			const uint32_t *right = src->pixels +
+				MIN(2 * x + 1, src->w - 1) * src->h;
+
+			for (int y = 0; y < dst->h; y++)
+			{
+				int y1 = MIN(2 * y + 1, src->h - 1);
+
+				dst->pixels[x * dst->h + y] = average_texels(left[2 * y],
+					left[y1], right[2 * y], right[y1]);
+			}
+		}
+	}
+	return (mips);
+}
+
+/**
+ * free_column_mips - Releases every level of a mip chain.
+ * @mips: The mip chain to release.
+ */
+void free_column_mips(ColumnMips *mips)
+{
+	free(mips->level[0].pixels);
+	memset(mips, 0, sizeof(*mips));
+}
+
+/**
+ * build_colormap - Fills the lighting table.
+ * @colormap: The table to fill.
+ * Description: Level l scales a channel by l / LIGHT_FULL, rounded, so
+ * LIGHT_FULL leaves colors unchanged and 0 is black. Distant surfaces fade
+ * to black, which doubles as distance fog.
+ */
+void build_colormap(Colormap colormap)
+{
+	for (int level = 0; level < LIGHT_LEVELS; level++)
+		for (int c = 0; c < 256; c++)
+			colormap[level][c] = (c * level + LIGHT_FULL / 2) / LIGHT_FULL;
+}
+
+/**
+ * struct FloorJob - Work shared by the threads casting the floor and ceiling
+ * @state: The State holding the floor and ceiling texels.
+ * @player: The player the rows are cast from.
+ * @map: the map which is used during the game.
+ * @pixels: The framebuffer being drawn.
+ * @pitch: The length of a framebuffer row in bytes.
+ * @nextRow: The first floor row not yet claimed by a thread.
+ */
+typedef struct FloorJob
+{
+	State *state;
+	Player *player;
+	const Map *map;
+	uint32_t *pixels;
+	int pitch;
+	SDL_atomic_t nextRow;
+} FloorJob;
+
+#define FLOOR_CHUNK 8
+
+/**
+ * sample_tile - Looks up the texel of a world position in a tile texture set
+ * @set: The texture set, one asset (or NULL) per map tile.
+ * @map: the map which is used during the game.
+ * @cell: The map cell the world position lies in.
+ * @fx: The world x-coordinate.
+ * @fy: The world y-coordinate.
+ * @flat: The color used when the tile has no texture.
+ * Return: The ARGB8888 texel.
+ */
+static inline uint32_t sample_tile(Asset *const *set,
+	const Map *map, Vec2I cell, float fx, float fy,
+	uint32_t flat)
+{
+	const Asset *asset;
+	const Texels *texels;
+	int tx, ty;
+
+	asset = set[map_tile(map, cell.x, cell.y)];
+	if (!asset)
+		return (flat);
+	texels = &asset->texels;
+	tx = (int)(texels->w * (fx - cell.x));
+	ty = (int)(texels->h * (fy - cell.y));
+	tx = MIN(MAX(tx, 0), texels->w - 1);
+	ty = MIN(MAX(ty, 0), texels->h - 1);
+	return (texels->pixels[ty * texels->w + tx]);
+}
+
+/**
+ * cast_floor_row - Draws one floor row and its mirrored ceiling row.
+ * @job: The FloorJob of the current frame.
+ * @y: The floor row, at or below the horizon.
+ * Description: The world position under the leftmost pixel, the
+ * per-pixel world step and the light level are computed once for the row;
+ * the pixels then only add the step, so the cost is one texel lookup per
+ * pixel plus a colormap lookup on rows that are not fully lit.
+ */
+static void cast_floor_row(FloorJob *job, int y)
+{
+	Player *player = job->player;
+	const uint32_t ground = 0xFF000000 | RGBA_Ground.r << 16 |
+		RGBA_Ground.g << 8 | RGBA_Ground.b;
+	const uint32_t ceiling = 0xFF000000 | RGBA_Ceiling.r << 16 |
+		RGBA_Ceiling.g << 8 | RGBA_Ceiling.b;
+	Vec2F rayLeft = {player->dir.x - player->plane.x,
+		player->dir.y - player->plane.y};
+	Vec2F rayRight = {player->dir.x + player->plane.x,
+		player->dir.y + player->plane.y};
+	/* Camera at half the wall height; sample the middle of the pixel row */
+	int width = job->state->viewW, height = job->state->viewH;
+	float rowDistance = (0.5f * height) / (y - height / 2 + 0.5f);
+	float stepX = rowDistance * (rayRight.x - rayLeft.x) / width;
+	float stepY = rowDistance * (rayRight.y - rayLeft.y) / width;
+	float fx = player->pos.x + rowDistance * rayLeft.x;
+	float fy = player->pos.y + rowDistance * rayLeft.y;
+	uint32_t *floorRow = (uint32_t *)((uint8_t *)job->pixels + y * job->pitch);
+	uint32_t *ceilingRow = (uint32_t *)((uint8_t *)job->pixels +
+		(height - 1 - y) * job->pitch);
+	int light = light_level(LIGHT_FULL, rowDistance);
+	const uint8_t *shade = job->state->colormap[light];
+
+	for (int x = 0; x < width; x++, fx += stepX, fy += stepY)
+	{
+		/* floorf() without the libm call: truncation rounds negatives up */
+		Vec2I cell = {(int)fx - (fx < (int)fx), (int)fy - (fy < (int)fy)};
+
+		floorRow[x] = sample_tile(job->state->floorTiles, job->map,
+			cell, fx, fy, ground);
+		ceilingRow[x] = sample_tile(job->state->ceilingTiles, job->map,
+			cell, fx, fy, ceiling);
+		if (light < LIGHT_FULL)
+		{
+			floorRow[x] = shade_texel(shade, floorRow[x]);
+			ceilingRow[x] = shade_texel(shade, ceilingRow[x]);
+		}
+	}
+}
+
+/**
+ * floor_task - Claims bands of floor rows and casts them until none are left
+ * @arg: The FloorJob of the current frame.
+ */
+static void floor_task(void *arg)
+{
+	FloorJob *job = arg;
+	int start, height = job->state->viewH;
+
+	while ((start = SDL_AtomicAdd(&job->nextRow, FLOOR_CHUNK) +
+		height / 2) < height)
+	{
+		int end = MIN(start + FLOOR_CHUNK, height);
+
+		for (int y = start; y < end; y++)
+			cast_floor_row(job, y);
+	}
+}
+
+/**
+ * render_floor_ceiling - Casts the textured floor and ceiling row by row.
+ * @state: A pointer to the State structure holding the texture sets.
+ * @player: A pointer to the Player structure the view is cast from.
+ * @map: The game map array used during the game.
+ * @pixels: The framebuffer to draw into, state->viewW x state->viewH
+ * ARGB8888.
+ * @pitch: The length of a framebuffer row in bytes.
+ * Description: Fills the whole framebuffer: every row below the horizon is
+ * floor and its mirror above is ceiling. Each pixel uses the texture that
+ * state->floorTiles (or state->ceilingTiles) holds for the tile under it,
+ * falling back to the flat ground (or ceiling) color when there is none.
+ * Rows are split across the thread pool. Walls are drawn on top afterwards.
+ */
+void render_floor_ceiling(State *state, Player *player,
+	const Map *map, uint32_t *pixels, int pitch)
+{
+	FloorJob job = {.state = state, .player = player, .map = map,
+		.pixels = pixels, .pitch = pitch};
+
+	SDL_AtomicSet(&job.nextRow, 0);
+	thread_pool_run(state->pool, floor_task, &job);
 }
 
 /**
@@ -82,5 +359,6 @@ void render_weapon(State *state)
 	/* Center the weapon horizontally */
 	weaponRect.y = SCREEN_H - weaponHeight;  /* 10 pixels from the bottom */
 
-	SDL_RenderCopy(state->renderer, state->weaponTexture[1], NULL, &weaponRect);
+	SDL_RenderCopy(state->renderer, state->weapon->texture, NULL, &weaponRect);
+	profile_draw(state, state->weapon->texture);
 }
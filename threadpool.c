@@ -0,0 +1,149 @@
+#include "structure.h"
+
+/**
+ * struct ThreadPool - A fixed set of worker threads sharing one task at a time
+ * @threads: The worker threads; the calling thread is not included.
+ * @numWorkers: The number of worker threads.
+ * @lock: Protects every field below.
+ * @workReady: Signalled when a new task is published or on shutdown.
+ * @workDone: Signalled when the last worker finishes the current task.
+ * @task: The task every thread runs for the current generation.
+ * @arg: The argument passed to @task.
+ * @generation: Incremented each time a task is published.
+ * @active: The number of workers still running the current task.
+ * @quit: Set when the pool is being destroyed.
+ */
+struct ThreadPool
+{
+	SDL_Thread **threads;
+	int numWorkers;
+	SDL_mutex *lock;
+	SDL_cond *workReady;
+	SDL_cond *workDone;
+	PoolTask task;
+	void *arg;
+	unsigned int generation;
+	int active;
+	bool quit;
+};
+
+/**
+ * worker_main - The loop every pool worker runs until the pool is destroyed.
+ * @data: The ThreadPool the worker belongs to.
+ * Return: Always 0.
+ */
+static int worker_main(void *data)
+{
+	ThreadPool *pool = data;
+	unsigned int seen = 0;
+
+	SDL_LockMutex(pool->lock);
+	while (true)
+	{
+		while (!pool->quit && pool->generation == seen)
+			SDL_CondWait(pool->workReady, pool->lock);
+		if (pool->quit)
+			break;
+		seen = pool->generation;
+		PoolTask task = pool->task;
+		void *arg = pool->arg;
+
+		SDL_UnlockMutex(pool->lock);
+		task(arg);
+		SDL_LockMutex(pool->lock);
+		if (--pool->active == 0)
+			SDL_CondSignal(pool->workDone);
+	}
+	SDL_UnlockMutex(pool->lock);
+	return (0);
+}
+
+/**
+ * create_thread_pool - Starts a pool of persistent worker threads.
+ * @numThreads: The number of threads that run each task, caller included.
+ * Return: The new pool; the program exits if it cannot be created.
+ */
+ThreadPool *create_thread_pool(int numThreads)
+{
+	ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+
+	ASSERT(pool, "Out of memory creating thread pool\n");
+	pool->numWorkers = MAX(numThreads - 1, 0);
+	pool->lock = SDL_CreateMutex();
+	pool->workReady = SDL_CreateCond();
+	pool->workDone = SDL_CreateCond();
+	ASSERT(pool->lock && pool->workReady && pool->workDone,
+		"failed to create thread pool: %s\n", SDL_GetError());
+	pool->threads = calloc(MAX(pool->numWorkers, 1), sizeof(SDL_Thread *));
+	ASSERT(pool->threads, "Out of memory creating thread pool\n");
+	for (int i = 0; i < pool->numWorkers; i++)
+	{
+		pool->threads[i] = SDL_CreateThread(worker_main, "raycast", pool);
+		ASSERT(pool->threads[i], "failed to create worker thread: %s\n",
+			SDL_GetError());
+	}
+	return (pool);
+}
+
+/**
+ * thread_pool_size - Gets the number of threads that run each task.
+ * @pool: The pool to query.
+ * Return: The number of workers plus the calling thread.
+ */
+int thread_pool_size(ThreadPool *pool)
+{
+	return (pool->numWorkers + 1);
+}
+
+/**
+ * thread_pool_run - Runs a task on every pool thread and waits for it.
+ * @pool: The pool to run the task on.
+ * @task: The task; it is called once per thread and must split the work
+ * itself, e.g. by claiming chunks from an atomic counter.
+ * @arg: The argument passed to every call of @task.
+ * Description: The calling thread runs the task too, so a pool of one
+ * thread runs it inline without any synchronization.
+ */
+void thread_pool_run(ThreadPool *pool, PoolTask task, void *arg)
+{
+	if (pool->numWorkers == 0)
+	{
+		task(arg);
+		return;
+	}
+	SDL_LockMutex(pool->lock);
+	pool->task = task;
+	pool->arg = arg;
+	pool->active = pool->numWorkers;
+	pool->generation++;
+	SDL_CondBroadcast(pool->workReady);
+	SDL_UnlockMutex(pool->lock);
+
+	task(arg);
+
+	SDL_LockMutex(pool->lock);
+	while (pool->active > 0)
+		SDL_CondWait(pool->workDone, pool->lock);
+	SDL_UnlockMutex(pool->lock);
+}
+
+/**
+ * destroy_thread_pool - Stops the workers and releases the pool.
+ * @pool: The pool to destroy, may be NULL.
+ */
+void destroy_thread_pool(ThreadPool *pool)
+{
+	if (!pool)
+		return;
+	SDL_LockMutex(pool->lock);
+	pool->quit = true;
+	SDL_CondBroadcast(pool->workReady);
+	SDL_UnlockMutex(pool->lock);
+	for (int i = 0; i < pool->numWorkers; i++)
+		SDL_WaitThread(pool->threads[i], NULL);
+	SDL_DestroyCond(pool->workDone);
+	SDL_DestroyCond(pool->workReady);
+	SDL_DestroyMutex(pool->lock);
+	free(pool->threads);
+	free(pool);
+}
@@ -0,0 +1,85 @@
+#include "../structure.h"
+
+/**
+ * print_usage - Prints the command line usage of the converter.
+ * @name: The name the program was started with.
+ */
+static void print_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s INPUT OUTPUT [--player X Y] [--enemy X Y]...\n"
+		"Converts a text map (or re-saves a binary one) to the binary map "
+		"format.\n", name);
+}
+
+/**
+ * parse_point - Parses two command line arguments as a map position.
+ * @args: The two arguments.
+ * @point: Where the position is stored.
+ * Return: true if both arguments are numbers.
+ */
+static bool parse_point(char **args, Vec2F *point)
+{
+	char *endX, *endY;
+
+	point->x = strtof(args[0], &endX);
+	point->y = strtof(args[1], &endY);
+	return (*args[0] && *args[1] && !*endX && !*endY);
+}
+
+/**
+ * main - Converts a map to the binary format loaded with mmap.
+ * @argc: The number of command line arguments.
+ * @argv: INPUT OUTPUT, optionally followed by spawn points.
+ * Return: 0 on success, 1 on failure or if the player would spawn in a
+ * wall.
+ */
+int main(int argc, char **argv)
+{
+	Map map;
+	Vec2F *spawns;
+	int numSpawns = 0;
+	bool ok;
+
+	if (argc < 3)
+	{
+		print_usage(argv[0]);
+		return (1);
+	}
+	/* The spawn is only checked once --player had its say */
+	if (!read_map_file(argv[1], &map))
+		return (1);
+	spawns = calloc(argc, sizeof(Vec2F));
+	ASSERT(spawns, "Out of memory\n");
+	for (int i = 3; i < argc; i += 3)
+	{
+		Vec2F point;
+
+		if (i + 2 >= argc || !parse_point(&argv[i + 1], &point) ||
+			(strcmp(argv[i], "--player") != 0 &&
+			strcmp(argv[i], "--enemy") != 0))
+		{
+			print_usage(argv[0]);
+			free(spawns);
+			free_map(&map);
+			return (1);
+		}
+		if (strcmp(argv[i], "--player") == 0)
+			map.playerSpawn = point;
+		else
+			spawns[numSpawns++] = point;
+	}
+	if (numSpawns > 0)
+	{
+		map.enemySpawns = spawns;
+		map.numEnemySpawns = numSpawns;
+	}
+	ok = check_player_spawn(&map) && save_binary_map(argv[2], &map);
+	if (ok)
+		printf("%s: %dx%d, %d enemy spawns\n", argv[2], map.width,
+			map.height, map.numEnemySpawns);
+	free(spawns);
+	map.enemySpawns = NULL;
+	map.numEnemySpawns = 0;
+	free_map(&map);
+	return (ok ? 0 : 1);
+}
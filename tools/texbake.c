@@ -0,0 +1,93 @@
+#include "../structure.h"
+#include <dirent.h>
+#include <strings.h>
+
+/**
+ * print_usage - Prints the command line usage of the baker.
+ * @name: The name the program was started with.
+ */
+static void print_usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s DIRECTORY OUTPUT\n"
+		"Bakes every image of a directory into a texture pack.\n", name);
+}
+
+/**
+ * is_image - Checks whether a file name has an image extension.
+ * @name: The file name.
+ * Return: true for .png, .jpg, .jpeg and .bmp files.
+ */
+static bool is_image(const char *name)
+{
+	static const char *const extensions[] = {".png", ".jpg", ".jpeg", ".bmp"};
+	const char *dot = strrchr(name, '.');
+
+	for (size_t i = 0; dot && i < sizeof(extensions) / sizeof(*extensions);
+		i++)
+		if (strcasecmp(dot, extensions[i]) == 0)
+			return (true);
+	return (false);
+}
+
+/**
+ * compare_paths - Orders paths alphabetically for qsort().
+ * @a: The first path.
+ * @b: The second path.
+ * Return: The strcmp() of the two paths.
+ */
+static int compare_paths(const void *a, const void *b)
+{
+	return (strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+/**
+ * main - Bakes a directory of images into a texture pack.
+ * @argc: The number of command line arguments.
+ * @argv: DIRECTORY OUTPUT.
+ * Return: 0 on success, 1 on failure.
+ * Description: The images are stored under DIRECTORY/NAME, so DIRECTORY
+ * must be given the way the game names it, e.g. "texture".
+ */
+int main(int argc, char **argv)
+{
+	DIR *dir;
+	struct dirent *file;
+	char **paths = NULL;
+	int count = 0;
+	size_t length;
+	bool ok;
+
+	if (argc != 3)
+	{
+		print_usage(argv[0]);
+		return (1);
+	}
+	length = strlen(argv[1]);
+	while (length > 1 && argv[1][length - 1] == '/')
+		argv[1][--length] = '\0';
+	dir = opendir(argv[1]);
+	if (!dir)
+	{
+		printf("Failed to open directory: %s\n", argv[1]);
+		return (1);
+	}
+	while ((file = readdir(dir)))
+	{
+		if (!is_image(file->d_name))
+			continue;
+		paths = realloc(paths, sizeof(char *) * (count + 1));
+		ASSERT(paths, "Out of memory\n");
+		paths[count] = malloc(strlen(argv[1]) + strlen(file->d_name) + 2);
+		ASSERT(paths[count], "Out of memory\n");
+		sprintf(paths[count++], "%s/%s", argv[1], file->d_name);
+	}
+	closedir(dir);
+	qsort(paths, count, sizeof(char *), compare_paths);
+	ok = save_texture_pack(argv[2], paths, count);
+	if (ok)
+		printf("%s: %d textures\n", argv[2], count);
+	for (int i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+	return (ok ? 0 : 1);
+}
@@ -0,0 +1,62 @@
+#include "structure.h"
+
+/**
+ * set_view_scale - Changes the resolution the 3D view is rendered at.
+ * @state: The game state.
+ * @scale: The new scale in VIEW_SCALE_UNIT-ths of the window size, clamped
+ * to [VIEW_SCALE_MIN, VIEW_SCALE_MAX].
+ * Description: Without a scene texture the view is drawn straight to the
+ * window, so it always has the window's size.
+ */
+void set_view_scale(State *state, int scale)
+{
+	ViewScaler *scaler = &state->scaler;
+
+	if (!state->sceneTexture)
+		scale = VIEW_SCALE_UNIT;
+	scale = MAX(scale, VIEW_SCALE_MIN);
+	scale = MIN(scale, VIEW_SCALE_MAX);
+	scaler->scale = scale;
+	scaler->samples = 0;
+	state->viewW = SCREEN_W * scale / VIEW_SCALE_UNIT;
+	state->viewH = SCREEN_H * scale / VIEW_SCALE_UNIT;
+}
+
+/**
+ * update_view_scale - Adapts the view resolution to the frame budget.
+ * @state: The game state.
+ * @renderMs: How long rendering and compositing the last frame took.
+ * Description: Called for frames whose scene was rendered again, not for
+ * the ones showing the cached view. Render time grows with the number of
+ * pixels, the square of the scale. Once VIEW_SETTLE_FRAMES frames were
+ * timed at a scale, a smoothed time over the budget shrinks the view to
+ * the scale predicted to fit, at least one step; the view only grows by
+ * one step, and only if the next scale is predicted to stay below 90% of
+ * the budget, so it does not flip back and forth.
+ */
+void update_view_scale(State *state, float renderMs)
+{
+	ViewScaler *scaler = &state->scaler;
+	float next;
+	int scale = scaler->scale;
+
+	if (scaler->budgetMs <= 0.0f || !state->sceneTexture)
+		return;
+	if (scaler->samples++ == 0)
+		scaler->averageMs = renderMs;
+	else
+		scaler->averageMs += (renderMs - scaler->averageMs) * 0.125f;
+	if (scaler->samples < VIEW_SETTLE_FRAMES)
+		return;
+	if (scaler->averageMs > scaler->budgetMs && scale > VIEW_SCALE_MIN)
+	{
+		int fit = (int)(scale * sqrtf(scaler->budgetMs / scaler->averageMs));
+
+		set_view_scale(state, MIN(fit, scale - 1));
+		return;
+	}
+	next = (float)(scale + 1) / scale;
+	if (scale < VIEW_SCALE_MAX &&
+		scaler->averageMs * next * next < scaler->budgetMs * 0.9f)
+		set_view_scale(state, scale + 1);
+}